@@ -0,0 +1,445 @@
+#include "threadpool.h"
+#include "parallel.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <algorithm>
+#include <random>
+#include <memory_resource>
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+#if defined(BENCH_STD_PAR)
+#include <execution>
+#endif
+
+// 基准测试
+// 编译: g++ -std=c++17 -O2 bench.cpp threadpool.cpp -o bench -lpthread
+// notify 对比场景输出线程池发出的通知次数; 实际的 futex 系统调用次数可配合 strace 统计: strace -f -c -e trace=futex ./bench
+// 与 std::execution::par 对比排序: g++ -std=c++17 -O2 -DBENCH_STD_PAR bench.cpp threadpool.cpp -o bench -lpthread -ltbb
+// 排序规模可由第一个参数指定, 例如 ./bench 100000000
+// 跨 L3 的缓存未命中可配合 perf 统计: perf stat -e LLC-load-misses,LLC-loads ./bench
+
+using namespace std::chrono_literals;
+using BenchClock = std::chrono::steady_clock;
+
+// 统计全局堆分配次数
+static std::atomic<long> g_heapAllocs{0};
+
+void *operator new(size_t size)
+{
+    g_heapAllocs.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// new_delete_resource 使用带对齐的重载
+void *operator new(size_t size, std::align_val_t align)
+{
+    g_heapAllocs.fetch_add(1, std::memory_order_relaxed);
+    size_t alignment = std::max(sizeof(void *), (size_t)align);
+    if (void *p = std::aligned_alloc(alignment, (std::max<size_t>(size, 1) + alignment - 1) / alignment * alignment))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+// 访问线程池仅供基准使用的内部开关
+struct ThreadPoolBenchAccess
+{
+    static void setAlwaysNotify(ThreadPool &pool, bool always) { pool.setAlwaysNotify(always); }
+};
+
+// 进程累计的主动/被动上下文切换次数 (阻塞在 futex 上会产生主动切换)
+struct CtxSwitches
+{
+    long voluntary = 0;
+    long involuntary = 0;
+};
+
+static CtxSwitches readCtxSwitches()
+{
+    CtxSwitches cs;
+#if defined(__linux__) || defined(__APPLE__)
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    cs.voluntary = usage.ru_nvcsw;
+    cs.involuntary = usage.ru_nivcsw;
+#endif
+    return cs;
+}
+
+// 运行一次场景并打印耗时、每任务耗时以及上下文切换次数
+static void runBench(const std::string &name, int taskCount, const std::function<void()> &body)
+{
+    CtxSwitches before = readCtxSwitches();
+    auto begin = BenchClock::now();
+    body();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(BenchClock::now() - begin);
+    CtxSwitches after = readCtxSwitches();
+
+    std::cout << std::left << std::setw(36) << name
+              << " tasks: " << std::setw(8) << taskCount
+              << " time: " << std::setw(8) << elapsed.count() / 1000.0 << " ms"
+              << " ns/task: " << std::setw(8) << (elapsed.count() * 1000.0 / taskCount)
+              << " vcsw: " << std::setw(8) << (after.voluntary - before.voluntary)
+              << " ivcsw: " << (after.involuntary - before.involuntary) << std::endl;
+}
+
+// 突发提交大量空任务后统一等待, 生产者几乎不会阻塞
+static void benchBurst(int threads, int taskCount, int spinCount, int batchSize = 1)
+{
+    runBench("burst (" + std::to_string(threads) + " thr, spin " + std::to_string(spinCount) +
+                 ", batch " + std::to_string(batchSize) + ")",
+             taskCount, [&]
+             {
+        ThreadPool pool;
+        pool.setIdleStrategy(spinCount);
+        pool.setTaskBatchSize(batchSize);
+        pool.start(threads);
+        std::vector<std::future<void>> futures;
+        futures.reserve(taskCount);
+        for (int i = 0; i < taskCount; ++i)
+        {
+            futures.push_back(pool.submitTask([] {}));
+        }
+        for (auto &f : futures)
+        {
+            f.get();
+        } });
+}
+
+// 提交一个任务并立即等待其结果, 衡量单次唤醒延迟
+static void benchPingPong(int threads, int taskCount, int spinCount)
+{
+    runBench("ping-pong (" + std::to_string(threads) + " thr, spin " + std::to_string(spinCount) + ")", taskCount, [&]
+             {
+        ThreadPool pool;
+        pool.setIdleStrategy(spinCount);
+        pool.start(threads);
+        for (int i = 0; i < taskCount; ++i)
+        {
+            pool.submitTask([] {}).get();
+        } });
+}
+
+// 有界队列: 生产者频繁阻塞在 notFull 上
+static void benchBoundedQueue(int threads, int taskCount, int queueCap)
+{
+    runBench("bounded queue (" + std::to_string(threads) + " thr, cap " + std::to_string(queueCap) + ")", taskCount, [&]
+             {
+        ThreadPool pool;
+        pool.setTaskQueMaxThreshHold(queueCap);
+        pool.start(threads);
+        std::vector<std::future<void>> futures;
+        futures.reserve(taskCount);
+        for (int i = 0; i < taskCount; ++i)
+        {
+            futures.push_back(pool.submitTask([] {}));
+        }
+        for (auto &f : futures)
+        {
+            f.get();
+        } });
+}
+
+// 同一场景分别以总是通知 (旧行为) 与按等待者数量通知运行, 对比通知次数, 上下文切换与耗时
+// 有线程阻塞等待时每次通知都是一次 futex 唤醒系统调用, 无人等待时 glibc 也要访问条件变量的共享状态
+static void benchNotifyModes(const std::string &name, int threads, int taskCount,
+                             const std::function<void(ThreadPool &)> &setup,
+                             const std::function<void(ThreadPool &)> &body)
+{
+    for (bool always : {true, false})
+    {
+        CtxSwitches before = readCtxSwitches();
+        std::chrono::microseconds elapsed{0};
+        uint64_t notifies = 0;
+        {
+            ThreadPool pool;
+            setup(pool);
+            ThreadPoolBenchAccess::setAlwaysNotify(pool, always);
+            pool.start(threads);
+            auto begin = BenchClock::now();
+            body(pool);
+            elapsed = std::chrono::duration_cast<std::chrono::microseconds>(BenchClock::now() - begin);
+            notifies = pool.getStats().notifies;
+        }
+        CtxSwitches after = readCtxSwitches();
+
+        std::cout << std::left << std::setw(40) << (name + (always ? " [always]" : " [counted]"))
+                  << " tasks: " << std::setw(8) << taskCount
+                  << " ns/task: " << std::setw(8) << (elapsed.count() * 1000.0 / taskCount)
+                  << " notifies: " << std::setw(8) << notifies
+                  << " vcsw: " << std::setw(8) << (after.voluntary - before.voluntary)
+                  << " ivcsw: " << (after.involuntary - before.involuntary) << std::endl;
+    }
+}
+
+static void submitAndWait(ThreadPool &pool, int taskCount)
+{
+    std::vector<std::future<void>> futures;
+    futures.reserve(taskCount);
+    for (int i = 0; i < taskCount; ++i)
+    {
+        futures.push_back(pool.submitTask([] {}));
+    }
+    for (auto &f : futures)
+    {
+        f.get();
+    }
+}
+
+// 线程池的完整生命周期: 构造, start(), 第一个任务完成, 析构
+static void benchStartup(int threads, bool lazy, int rounds)
+{
+    long long startUs = 0;
+    long long firstTaskUs = 0;
+    long long totalUs = 0;
+    for (int r = 0; r < rounds; ++r)
+    {
+        auto begin = BenchClock::now();
+        {
+            ThreadPool pool;
+            pool.setLazyStart(lazy);
+            pool.start(threads);
+            auto started = BenchClock::now();
+            pool.submitTask([] {}).get();
+            auto firstTask = BenchClock::now();
+
+            startUs += std::chrono::duration_cast<std::chrono::microseconds>(started - begin).count();
+            firstTaskUs += std::chrono::duration_cast<std::chrono::microseconds>(firstTask - begin).count();
+        }
+        totalUs += std::chrono::duration_cast<std::chrono::microseconds>(BenchClock::now() - begin).count();
+    }
+
+    std::cout << std::left << std::setw(36)
+              << ("startup (" + std::to_string(threads) + " thr, " + (lazy ? "lazy" : "eager") + ")")
+              << " start(): " << std::setw(8) << (double)startUs / rounds << " us"
+              << " first task: " << std::setw(8) << (double)firstTaskUs / rounds << " us"
+              << " lifecycle: " << (double)totalUs / rounds << " us" << std::endl;
+}
+
+// 稳态下每个任务的全局堆分配次数与耗时: 默认的任务内存资源应全部复用节点, 且不慢于直接使用 malloc
+// resource 为空时使用默认资源, 否则通过 setTaskMemoryResource 替换以作对比
+static void benchSteadyStateAllocs(int threads, int batches, int batchSize, const std::string &resourceName,
+                                   std::pmr::memory_resource *resource)
+{
+    ThreadPool pool;
+    if (resource != nullptr)
+    {
+        pool.setTaskMemoryResource(resource);
+    }
+    pool.start(threads);
+    std::vector<std::future<int>> futures;
+    futures.reserve(batchSize);
+
+    auto runBatches = [&](int count)
+    {
+        for (int b = 0; b < count; ++b)
+        {
+            for (int i = 0; i < batchSize; ++i)
+            {
+                futures.push_back(pool.submitTask([i] { return i; }));
+            }
+            for (auto &f : futures)
+            {
+                f.get();
+            }
+            futures.clear();
+        }
+    };
+
+    runBatches(10); // 预热, 让内存池与任务队列达到稳态容量
+    long before = g_heapAllocs.load();
+    auto begin = BenchClock::now();
+    runBatches(batches);
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - begin);
+    long allocs = g_heapAllocs.load() - before;
+
+    std::cout << std::left << std::setw(36) << ("steady state (" + std::to_string(threads) + " thr, " + resourceName + ")")
+              << " tasks: " << std::setw(8) << batches * batchSize
+              << " ns/task: " << std::setw(8) << (double)elapsed.count() / (batches * batchSize)
+              << " heap allocs: " << std::setw(8) << allocs
+              << " allocs/task: " << (double)allocs / (batches * batchSize) << std::endl;
+}
+
+// 窃取局部性: 每个父任务写一块数据, 再以自己为首选线程提交若干读取该数据的子任务,
+// 子任务积压后被其他线程窃取; 拓扑感知时优先由共享 L3 的线程窃取, 跨分组读取更少
+static void benchStealLocality(int threads, int parents, bool topology)
+{
+    const int children = 8;
+    const size_t words = 8 * 1024; // 每块 64KB
+    runBench(std::string("steal locality (") + std::to_string(threads) + " thr, " +
+                 (topology ? "topology" : "flat") + ")",
+             parents * children, [&]
+             {
+        ThreadPool pool;
+        pool.setTopologyAware(topology);
+        pool.setTaskBatchSize(8);
+        pool.setAffinityStealThreshHold(2);
+        pool.start(threads);
+        std::atomic<uint64_t> checksum{0};
+        std::vector<uint64_t> blocks(parents * words);
+        std::vector<std::future<void>> futures;
+        futures.reserve(parents);
+        for (int p = 0; p < parents; ++p)
+        {
+            futures.push_back(pool.submitTask([&pool, &checksum, &blocks, p, words]
+                                              {
+                uint64_t *data = blocks.data() + p * words;
+                std::fill(data, data + words, (uint64_t)p);
+                std::vector<TaskFuture<void>> reads; // 等待时先执行队列中的任务
+                for (int c = 0; c < children; ++c)
+                {
+                    reads.push_back(pool.submitWithAffinity(ThreadPool::currentWorkerIndex(), [data, words, &checksum]
+                                                            {
+                        uint64_t sum = 0;
+                        for (size_t i = 0; i < words; ++i)
+                        {
+                            sum += data[i];
+                        }
+                        checksum.fetch_add(sum, std::memory_order_relaxed); }));
+                }
+                for (auto &r : reads)
+                {
+                    r.get();
+                } }));
+        }
+        for (auto &f : futures)
+        {
+            f.get();
+        } });
+}
+
+// 大数组排序: 同一份随机输入分别用 std::sort, std::execution::par 以及不同大小线程池上的 parallel::sort
+static void benchSort(size_t n, const std::vector<int> &poolSizes)
+{
+    std::vector<int> input(n);
+    std::mt19937 rng(42);
+    for (auto &x : input)
+    {
+        x = (int)rng();
+    }
+    std::vector<int> data;
+
+    auto report = [&](const std::string &name, long long us)
+    {
+        std::cout << std::left << std::setw(36) << name
+                  << " elements: " << std::setw(10) << n
+                  << " time: " << std::setw(10) << us / 1000.0 << " ms"
+                  << " sorted: " << (std::is_sorted(data.begin(), data.end()) ? "yes" : "NO") << std::endl;
+    };
+    auto timed = [&](const std::function<void()> &body)
+    {
+        data = input;
+        auto begin = BenchClock::now();
+        body();
+        return (long long)std::chrono::duration_cast<std::chrono::microseconds>(BenchClock::now() - begin).count();
+    };
+
+    report("std::sort", timed([&]
+                              { std::sort(data.begin(), data.end()); }));
+#if defined(BENCH_STD_PAR)
+    report("std::sort(std::execution::par)", timed([&]
+                                                   { std::sort(std::execution::par, data.begin(), data.end()); }));
+#endif
+    for (int threads : poolSizes)
+    {
+        ThreadPool pool;
+        pool.start(threads);
+        report("parallel::sort (" + std::to_string(threads) + " thr)", timed([&]
+                                                                          { parallel::sort(pool.par(), data.begin(), data.end()); }));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int hw = std::max(1u, std::thread::hardware_concurrency());
+    size_t sortSize = argc > 1 ? std::stoull(argv[1]) : 10000000;
+
+    std::cout << "\n=========== BENCH: enqueue/dequeue handshake ===========\n";
+    benchBurst(hw, 200000, 0);
+    benchBurst(hw, 200000, 2000);
+    benchBurst(hw, 200000, 0, 16);
+    benchBurst(4 * hw, 200000, 0);
+    benchBurst(4 * hw, 200000, 0, 16);
+    benchPingPong(hw, 20000, 0);
+    benchPingPong(hw, 20000, 2000);
+    benchBoundedQueue(hw, 200000, 64);
+
+    std::cout << "\n=========== BENCH: notify always vs. waiter-counted ===========\n";
+    benchNotifyModes("burst (" + std::to_string(hw) + " thr)", hw, 200000, [](ThreadPool &) {}, [](ThreadPool &pool)
+                     { submitAndWait(pool, 200000); });
+    benchNotifyModes("ping-pong (" + std::to_string(hw) + " thr)", hw, 20000, [](ThreadPool &) {}, [](ThreadPool &pool)
+                     {
+        for (int i = 0; i < 20000; ++i)
+        {
+            pool.submitTask([] {}).get();
+        } });
+    benchNotifyModes("bounded queue (" + std::to_string(hw) + " thr, cap 64)", hw, 200000, [](ThreadPool &pool)
+                     { pool.setTaskQueMaxThreshHold(64); }, [](ThreadPool &pool)
+                     { submitAndWait(pool, 200000); });
+
+    std::cout << "\n=========== BENCH: task allocation ===========\n";
+    {
+        std::pmr::synchronized_pool_resource syncPool;
+        for (int threads : {1, hw, 4 * hw})
+        {
+            benchSteadyStateAllocs(threads, 100, 1000, "default", nullptr);
+            benchSteadyStateAllocs(threads, 100, 1000, "malloc", std::pmr::new_delete_resource());
+            benchSteadyStateAllocs(threads, 100, 1000, "sync pool", &syncPool);
+        }
+    }
+
+    std::cout << "\n=========== BENCH: pool startup ===========\n";
+    for (int threads : {hw, 4 * hw, 16 * hw})
+    {
+        benchStartup(threads, false, 50);
+        benchStartup(threads, true, 50);
+    }
+
+    std::cout << "\n=========== BENCH: steal locality ===========\n";
+    std::cout << "L3 groups: " << ThreadPool::readCacheTopology().size() << std::endl;
+    benchStealLocality(hw, 500, false);
+    benchStealLocality(hw, 500, true);
+
+    std::cout << "\n=========== BENCH: parallel sort ===========\n";
+    std::vector<int> poolSizes = {1, 2, 4};
+    for (int threads = 8; threads <= 2 * hw; threads *= 2)
+    {
+        poolSizes.push_back(threads);
+    }
+    benchSort(sortSize, poolSizes);
+
+    return 0;
+}
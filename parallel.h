@@ -0,0 +1,554 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "threadpool.h"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <vector>
+#include <type_traits>
+
+// 基于 ThreadPool::parallelFor 的并行算法, 接口与 <algorithm>/<numeric> 中带执行策略的重载一致,
+// 执行策略由 pool.par() 给出; 调用者线程参与计算, 可以在线程池的任务中调用
+// 仅支持随机访问迭代器
+namespace parallel
+{
+    using Policy = ThreadPool::ParallelPolicy;
+
+    namespace detail
+    {
+        template <typename It>
+        using Value = typename std::iterator_traits<It>::value_type;
+
+        template <typename It>
+        constexpr bool isRandomAccess = std::is_base_of<std::random_access_iterator_tag,
+                                                        typename std::iterator_traits<It>::iterator_category>::value;
+
+        // 需要按块汇总的算法 (reduce/scan/copy_if) 使用的块数
+        inline size_t blockCount(const Policy &policy, size_t n)
+        {
+            if (n == 0)
+            {
+                return 0;
+            }
+            if (policy.grainSize > 0)
+            {
+                return (n + policy.grainSize - 1) / policy.grainSize;
+            }
+            size_t workers = (size_t)std::max(1, policy.pool->getCurrentThreadCount());
+            return std::min(n, 4 * (workers + 1));
+        }
+
+        // 第 b 块 (共 blocks 块) 的起始下标
+        inline size_t blockBegin(size_t n, size_t blocks, size_t b)
+        {
+            return n / blocks * b + std::min(b, n % blocks);
+        }
+
+        // 对每块调用 body(b, lo, hi)
+        template <typename Body>
+        void forEachBlock(const Policy &policy, size_t n, size_t blocks, Body &&body)
+        {
+            policy.pool->parallelFor(0, blocks, [&](size_t first, size_t last)
+                                     {
+                for (size_t b = first; b < last; b++)
+                {
+                    body(b, blockBegin(n, blocks, b), blockBegin(n, blocks, b + 1));
+                } }, 1);
+        }
+
+        // 归并路径划分: 返回 i, 使 a[0, i) 与 b[0, k - i) 恰为两个有序序列归并结果的前 k 个元素
+        // 相等元素优先取自 a, 与 std::merge 的稳定性一致
+        template <typename It1, typename It2, typename Compare>
+        size_t coRank(size_t k, It1 a, size_t n, It2 b, size_t m, Compare comp)
+        {
+            size_t lo = k > m ? k - m : 0;
+            size_t hi = std::min(k, n);
+            while (lo < hi)
+            {
+                size_t i = lo + (hi - lo) / 2;
+                size_t j = k - i;
+                if (j > 0 && i < n && !comp(b[j - 1], a[i]))
+                {
+                    lo = i + 1;
+                }
+                else
+                {
+                    hi = i;
+                }
+            }
+            return lo;
+        }
+
+        // 与 std::merge 相同, 但比较直接作用于元素本身, 只在写出时移动
+        template <typename It1, typename It2, typename OutIt, typename Compare>
+        OutIt moveMerge(It1 a, It1 aEnd, It2 b, It2 bEnd, OutIt out, Compare comp)
+        {
+            while (a != aEnd && b != bEnd)
+            {
+                if (comp(*b, *a))
+                {
+                    *out = std::move(*b);
+                    ++b;
+                }
+                else
+                {
+                    *out = std::move(*a);
+                    ++a;
+                }
+                ++out;
+            }
+            out = std::move(a, aEnd, out);
+            return std::move(b, bEnd, out);
+        }
+
+        // 把输出区间 [outLo, outHi) 对应的那部分归并结果写入 out; Move 为 true 时移动而非复制输入元素
+        template <bool Move = false, typename It1, typename It2, typename OutIt, typename Compare>
+        void mergeRange(It1 a, size_t n, It2 b, size_t m, OutIt out, size_t outLo, size_t outHi, Compare comp)
+        {
+            size_t i0 = coRank(outLo, a, n, b, m, comp);
+            size_t i1 = coRank(outHi, a, n, b, m, comp);
+            if constexpr (Move)
+            {
+                moveMerge(a + i0, a + i1, b + (outLo - i0), b + (outHi - i1), out + outLo, comp);
+            }
+            else
+            {
+                std::merge(a + i0, a + i1, b + (outLo - i0), b + (outHi - i1), out + outLo, comp);
+            }
+        }
+
+        // 排序用的未初始化缓冲区, 不要求 T 可默认构造; 各块构造完成后登记, 析构时只销毁已登记的元素
+        template <typename T>
+        class TempBuffer
+        {
+        public:
+            TempBuffer(size_t n, size_t blocks)
+                : data_(std::allocator<T>().allocate(n)), size_(n), begins_(blocks, 0), ends_(blocks, 0) {}
+            ~TempBuffer()
+            {
+                for (size_t b = 0; b < ends_.size(); b++)
+                {
+                    std::destroy(data_ + begins_[b], data_ + ends_[b]);
+                }
+                std::allocator<T>().deallocate(data_, size_);
+            }
+            TempBuffer(const TempBuffer &) = delete;
+            TempBuffer &operator=(const TempBuffer &) = delete;
+
+            T *get() const { return data_; }
+            // 第 b 块的 [lo, hi) 已构造; 不同块可由不同线程登记
+            void constructed(size_t b, size_t lo, size_t hi)
+            {
+                begins_[b] = lo;
+                ends_[b] = hi;
+            }
+
+        private:
+            T *data_;
+            size_t size_;
+            std::vector<size_t> begins_;
+            std::vector<size_t> ends_;
+        };
+    }
+
+    template <typename RandomIt, typename Func>
+    void for_each(const Policy &policy, RandomIt first, RandomIt last, Func f)
+    {
+        static_assert(detail::isRandomAccess<RandomIt>, "parallel algorithms require random access iterators");
+        policy.pool->parallelFor(0, (size_t)(last - first), [&](size_t lo, size_t hi)
+                                 { std::for_each(first + lo, first + hi, f); },
+                                 policy.grainSize);
+    }
+
+    template <typename RandomIt, typename OutIt, typename UnaryOp>
+    OutIt transform(const Policy &policy, RandomIt first, RandomIt last, OutIt dFirst, UnaryOp op)
+    {
+        static_assert(detail::isRandomAccess<RandomIt> && detail::isRandomAccess<OutIt>,
+                      "parallel algorithms require random access iterators");
+        size_t n = (size_t)(last - first);
+        policy.pool->parallelFor(0, n, [&](size_t lo, size_t hi)
+                                 { std::transform(first + lo, first + hi, dFirst + lo, op); },
+                                 policy.grainSize);
+        return dFirst + n;
+    }
+
+    template <typename RandomIt1, typename RandomIt2, typename OutIt, typename BinaryOp>
+    OutIt transform(const Policy &policy, RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, OutIt dFirst, BinaryOp op)
+    {
+        static_assert(detail::isRandomAccess<RandomIt1> && detail::isRandomAccess<RandomIt2> &&
+                          detail::isRandomAccess<OutIt>,
+                      "parallel algorithms require random access iterators");
+        size_t n = (size_t)(last1 - first1);
+        policy.pool->parallelFor(0, n, [&](size_t lo, size_t hi)
+                                 { std::transform(first1 + lo, first1 + hi, first2 + lo, dFirst + lo, op); },
+                                 policy.grainSize);
+        return dFirst + n;
+    }
+
+    // reduceOp 须满足结合律与交换律
+    template <typename RandomIt, typename T, typename BinaryReduceOp, typename UnaryTransformOp>
+    T transform_reduce(const Policy &policy, RandomIt first, RandomIt last, T init, BinaryReduceOp reduceOp,
+                       UnaryTransformOp transformOp)
+    {
+        static_assert(detail::isRandomAccess<RandomIt>, "parallel algorithms require random access iterators");
+        size_t n = (size_t)(last - first);
+        size_t blocks = detail::blockCount(policy, n);
+        if (blocks == 0)
+        {
+            return init;
+        }
+        // 每块以自己的第一个元素为初值, 不要求 T 有单位元
+        std::vector<T> partial(blocks, init);
+        detail::forEachBlock(policy, n, blocks, [&](size_t b, size_t lo, size_t hi)
+                             {
+            T sum = transformOp(first[lo]);
+            for (size_t i = lo + 1; i < hi; i++)
+            {
+                sum = reduceOp(std::move(sum), transformOp(first[i]));
+            }
+            partial[b] = std::move(sum); });
+
+        T result = std::move(init);
+        for (auto &p : partial)
+        {
+            result = reduceOp(std::move(result), std::move(p));
+        }
+        return result;
+    }
+
+    template <typename RandomIt1, typename RandomIt2, typename T, typename BinaryReduceOp, typename BinaryTransformOp>
+    T transform_reduce(const Policy &policy, RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, T init,
+                       BinaryReduceOp reduceOp, BinaryTransformOp transformOp)
+    {
+        static_assert(detail::isRandomAccess<RandomIt1> && detail::isRandomAccess<RandomIt2>,
+                      "parallel algorithms require random access iterators");
+        size_t n = (size_t)(last1 - first1);
+        size_t blocks = detail::blockCount(policy, n);
+        if (blocks == 0)
+        {
+            return init;
+        }
+        std::vector<T> partial(blocks, init);
+        detail::forEachBlock(policy, n, blocks, [&](size_t b, size_t lo, size_t hi)
+                             {
+            T sum = transformOp(first1[lo], first2[lo]);
+            for (size_t i = lo + 1; i < hi; i++)
+            {
+                sum = reduceOp(std::move(sum), transformOp(first1[i], first2[i]));
+            }
+            partial[b] = std::move(sum); });
+
+        T result = std::move(init);
+        for (auto &p : partial)
+        {
+            result = reduceOp(std::move(result), std::move(p));
+        }
+        return result;
+    }
+
+    template <typename RandomIt1, typename RandomIt2, typename T>
+    T transform_reduce(const Policy &policy, RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, T init)
+    {
+        return parallel::transform_reduce(policy, first1, last1, first2, std::move(init), std::plus<>(), std::multiplies<>());
+    }
+
+    template <typename RandomIt, typename T, typename BinaryOp = std::plus<>>
+    T reduce(const Policy &policy, RandomIt first, RandomIt last, T init, BinaryOp op = BinaryOp())
+    {
+        return parallel::transform_reduce(policy, first, last, std::move(init), op, [](const auto &x)
+                                          { return x; });
+    }
+
+    // 两遍扫描: 先求各块之和, 串行求块间前缀, 再各块带偏移量扫描; op 须满足结合律, 不要求交换律
+    template <typename RandomIt, typename OutIt, typename BinaryOp = std::plus<>>
+    OutIt inclusive_scan(const Policy &policy, RandomIt first, RandomIt last, OutIt dFirst, BinaryOp op = BinaryOp())
+    {
+        static_assert(detail::isRandomAccess<RandomIt> && detail::isRandomAccess<OutIt>,
+                      "parallel algorithms require random access iterators");
+        using T = detail::Value<RandomIt>;
+        size_t n = (size_t)(last - first);
+        size_t blocks = detail::blockCount(policy, n);
+        if (blocks == 0)
+        {
+            return dFirst;
+        }
+
+        std::vector<T> blockSums(blocks);
+        detail::forEachBlock(policy, n, blocks, [&](size_t b, size_t lo, size_t hi)
+                             { blockSums[b] = std::accumulate(first + lo + 1, first + hi, T(first[lo]), op); });
+        // blockSums[b] 变为第 b 块之前所有元素之和 (第 0 块不使用)
+        for (size_t b = 1; b < blocks; b++)
+        {
+            blockSums[b] = op(blockSums[b - 1], blockSums[b]);
+        }
+        detail::forEachBlock(policy, n, blocks, [&](size_t b, size_t lo, size_t hi)
+                             {
+            if (b == 0)
+            {
+                std::inclusive_scan(first + lo, first + hi, dFirst + lo, op);
+            }
+            else
+            {
+                std::inclusive_scan(first + lo, first + hi, dFirst + lo, op, blockSums[b - 1]);
+            } });
+        return dFirst + n;
+    }
+
+    template <typename RandomIt, typename OutIt, typename T, typename BinaryOp = std::plus<>>
+    OutIt exclusive_scan(const Policy &policy, RandomIt first, RandomIt last, OutIt dFirst, T init, BinaryOp op = BinaryOp())
+    {
+        static_assert(detail::isRandomAccess<RandomIt> && detail::isRandomAccess<OutIt>,
+                      "parallel algorithms require random access iterators");
+        size_t n = (size_t)(last - first);
+        size_t blocks = detail::blockCount(policy, n);
+        if (blocks == 0)
+        {
+            return dFirst;
+        }
+
+        std::vector<T> blockSums(blocks, init);
+        detail::forEachBlock(policy, n, blocks, [&](size_t b, size_t lo, size_t hi)
+                             { blockSums[b] = std::accumulate(first + lo + 1, first + hi, T(first[lo]), op); });
+        // 转为各块的起始值
+        T carry = init;
+        for (size_t b = 0; b < blocks; b++)
+        {
+            T next = op(carry, blockSums[b]);
+            blockSums[b] = std::move(carry);
+            carry = std::move(next);
+        }
+        detail::forEachBlock(policy, n, blocks, [&](size_t b, size_t lo, size_t hi)
+                             { std::exclusive_scan(first + lo, first + hi, dFirst + lo, blockSums[b], op); });
+        return dFirst + n;
+    }
+
+    // 先并行求值并统计各块命中数, 再按前缀和确定各块的输出位置; 每个元素只调用一次 pred
+    template <typename RandomIt, typename OutIt, typename UnaryPredicate>
+    OutIt copy_if(const Policy &policy, RandomIt first, RandomIt last, OutIt dFirst, UnaryPredicate pred)
+    {
+        static_assert(detail::isRandomAccess<RandomIt> && detail::isRandomAccess<OutIt>,
+                      "parallel algorithms require random access iterators");
+        size_t n = (size_t)(last - first);
+        size_t blocks = detail::blockCount(policy, n);
+        if (blocks == 0)
+        {
+            return dFirst;
+        }
+
+        std::vector<unsigned char> selected(n);
+        std::vector<size_t> offsets(blocks + 1, 0);
+        detail::forEachBlock(policy, n, blocks, [&](size_t b, size_t lo, size_t hi)
+                             {
+            size_t hits = 0;
+            for (size_t i = lo; i < hi; i++)
+            {
+                selected[i] = pred(first[i]) ? 1 : 0;
+                hits += selected[i];
+            }
+            offsets[b + 1] = hits; });
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        detail::forEachBlock(policy, n, blocks, [&](size_t b, size_t lo, size_t hi)
+                             {
+            OutIt out = dFirst + offsets[b];
+            for (size_t i = lo; i < hi; i++)
+            {
+                if (selected[i])
+                {
+                    *out++ = first[i];
+                }
+            } });
+        return dFirst + offsets[blocks];
+    }
+
+    // 按输出位置均匀分块, 每块用归并路径划分找到两个输入中的对应区间后独立归并
+    template <typename RandomIt1, typename RandomIt2, typename OutIt, typename Compare = std::less<>>
+    OutIt merge(const Policy &policy, RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, RandomIt2 last2,
+                OutIt dFirst, Compare comp = Compare())
+    {
+        static_assert(detail::isRandomAccess<RandomIt1> && detail::isRandomAccess<RandomIt2> &&
+                          detail::isRandomAccess<OutIt>,
+                      "parallel algorithms require random access iterators");
+        size_t n = (size_t)(last1 - first1);
+        size_t m = (size_t)(last2 - first2);
+        policy.pool->parallelFor(0, n + m, [&](size_t lo, size_t hi)
+                                 { detail::mergeRange(first1, n, first2, m, dFirst, lo, hi, comp); },
+                                 policy.grainSize);
+        return dFirst + (n + m);
+    }
+
+    // 并行归并排序: 各块并行 std::stable_sort, 之后每轮把相邻有序段两两归并, 每轮按输出位置均匀分块并行
+    // 归并时相等元素优先取自左段, 因此排序是稳定的
+    template <typename RandomIt, typename Compare = std::less<>>
+    void stable_sort(const Policy &policy, RandomIt first, RandomIt last, Compare comp = Compare())
+    {
+        static_assert(detail::isRandomAccess<RandomIt>, "parallel algorithms require random access iterators");
+        using T = detail::Value<RandomIt>;
+        size_t n = (size_t)(last - first);
+        size_t runs = detail::blockCount(policy, n);
+        if (runs <= 1)
+        {
+            std::stable_sort(first, last, comp);
+            return;
+        }
+
+        // 各块移入缓冲区后在缓冲区内排序, 之后的每轮归并都在两个已构造的区域之间移动元素
+        detail::TempBuffer<T> buffer(n, runs);
+        detail::forEachBlock(policy, n, runs, [&](size_t b, size_t lo, size_t hi)
+                             {
+            std::uninitialized_move(first + lo, first + hi, buffer.get() + lo);
+            buffer.constructed(b, lo, hi);
+            std::stable_sort(buffer.get() + lo, buffer.get() + hi, comp); });
+
+        bool inBuffer = true; // 当前有序段位于 buffer 中
+        size_t workers = (size_t)std::max(1, policy.pool->getCurrentThreadCount());
+        // 归并以 run 为单位, 边界与 blockBegin 一致
+        for (size_t width = 1; width < runs; width *= 2)
+        {
+            auto mergeRound = [&](auto src, auto dst)
+            {
+                size_t pairs = (runs + 2 * width - 1) / (2 * width);
+                policy.pool->parallelFor(0, pairs, [&](size_t firstPair, size_t lastPair)
+                                         {
+                    for (size_t p = firstPair; p < lastPair; p++)
+                    {
+                        size_t lo = detail::blockBegin(n, runs, std::min(runs, 2 * width * p));
+                        size_t mid = detail::blockBegin(n, runs, std::min(runs, 2 * width * p + width));
+                        size_t hi = detail::blockBegin(n, runs, std::min(runs, 2 * width * (p + 1)));
+                        if (pairs >= 2 * workers)
+                        {
+                            detail::moveMerge(src + lo, src + mid, src + mid, src + hi, dst + lo, comp);
+                        }
+                        else
+                        {
+                            // 最后几轮只剩少数几对, 每对再按输出位置分块并行归并
+                            policy.pool->parallelFor(0, hi - lo, [&](size_t outLo, size_t outHi)
+                                                     { detail::mergeRange<true>(src + lo, mid - lo, src + mid, hi - mid, dst + lo,
+                                                                                outLo, outHi, comp); });
+                        }
+                    } }, 1);
+            };
+            if (inBuffer)
+            {
+                mergeRound(buffer.get(), first);
+            }
+            else
+            {
+                mergeRound(first, buffer.get());
+            }
+            inBuffer = !inBuffer;
+        }
+        if (inBuffer)
+        {
+            parallel::transform(policy, buffer.get(), buffer.get() + n, first, [](T &x)
+                                { return std::move(x); });
+        }
+    }
+
+    // 并行样本排序, 适合 10^8 量级的大数组:
+    //  1. 等间隔抽样并排序, 选出 buckets - 1 个分隔值
+    //  2. 各块并行统计每个元素所属的桶, 由前缀和得到每块每桶的写入位置 (无需加锁)
+    //  3. 各块并行把元素移动到缓冲区中各自的桶内
+    //  4. 各桶并行排序后移回原数组; 重复值过多导致的超大桶再递归使用并行归并排序
+    // 数据量较小或元素的移动构造可能抛出异常时直接使用 stable_sort 的并行归并
+    template <typename RandomIt, typename Compare = std::less<>>
+    void sort(const Policy &policy, RandomIt first, RandomIt last, Compare comp = Compare())
+    {
+        static_assert(detail::isRandomAccess<RandomIt>, "parallel algorithms require random access iterators");
+        using T = detail::Value<RandomIt>;
+        const size_t SAMPLE_SORT_MIN_SIZE = 1 << 16;
+        const size_t OVERSAMPLING = 32;
+
+        size_t n = (size_t)(last - first);
+        size_t workers = (size_t)std::max(1, policy.pool->getCurrentThreadCount());
+        if (n < SAMPLE_SORT_MIN_SIZE || workers == 1 || !std::is_nothrow_move_constructible<T>::value)
+        {
+            parallel::stable_sort(policy, first, last, comp);
+            return;
+        }
+
+        size_t blocks = detail::blockCount(policy, n);
+        size_t buckets = std::min<size_t>(4 * workers, 1024);
+
+        // 1. 抽样选分隔值
+        size_t sampleCount = buckets * OVERSAMPLING;
+        std::vector<T> samples;
+        samples.reserve(sampleCount);
+        for (size_t i = 0; i < sampleCount; i++)
+        {
+            samples.push_back(first[(size_t)((double)n * (i + 0.5) / sampleCount)]);
+        }
+        std::sort(samples.begin(), samples.end(), comp);
+        std::vector<T> splitters;
+        splitters.reserve(buckets - 1);
+        for (size_t k = 1; k < buckets; k++)
+        {
+            splitters.push_back(samples[k * OVERSAMPLING]);
+        }
+        auto bucketOf = [&](const T &x)
+        {
+            return (size_t)(std::upper_bound(splitters.begin(), splitters.end(), x, comp) - splitters.begin());
+        };
+
+        // 2. 统计, counts[b * buckets + k] 为第 b 块落入第 k 桶的元素数, 之后改为写入位置
+        // 记下每个元素的桶号: 分发时不再调用 comp, 向未初始化缓冲区构造元素的过程不会抛出异常
+        std::vector<size_t> counts(blocks * buckets, 0);
+        std::vector<uint16_t> bucketIds(n);
+        detail::forEachBlock(policy, n, blocks, [&](size_t b, size_t lo, size_t hi)
+                             {
+            size_t *row = &counts[b * buckets];
+            for (size_t i = lo; i < hi; i++)
+            {
+                size_t k = bucketOf(first[i]);
+                bucketIds[i] = (uint16_t)k;
+                row[k]++;
+            } });
+        std::vector<size_t> bucketBegin(buckets + 1, 0);
+        size_t offset = 0;
+        for (size_t k = 0; k < buckets; k++)
+        {
+            bucketBegin[k] = offset;
+            for (size_t b = 0; b < blocks; b++)
+            {
+                size_t c = counts[b * buckets + k];
+                counts[b * buckets + k] = offset;
+                offset += c;
+            }
+        }
+        bucketBegin[buckets] = n;
+
+        // 3. 分发到缓冲区
+        detail::TempBuffer<T> buffer(n, 1);
+        detail::forEachBlock(policy, n, blocks, [&](size_t b, size_t lo, size_t hi)
+                             {
+            size_t *row = &counts[b * buckets];
+            for (size_t i = lo; i < hi; i++)
+            {
+                ::new ((void *)(buffer.get() + row[bucketIds[i]]++)) T(std::move(first[i]));
+            } });
+        buffer.constructed(0, 0, n);
+
+        // 4. 各桶排序并移回
+        size_t largeBucket = 2 * n / buckets;
+        policy.pool->parallelFor(0, buckets, [&](size_t firstBucket, size_t lastBucket)
+                                 {
+            for (size_t k = firstBucket; k < lastBucket; k++)
+            {
+                T *lo = buffer.get() + bucketBegin[k];
+                T *hi = buffer.get() + bucketBegin[k + 1];
+                if ((size_t)(hi - lo) > largeBucket)
+                {
+                    parallel::stable_sort(Policy{policy.pool, 0}, lo, hi, comp);
+                }
+                else
+                {
+                    std::sort(lo, hi, comp);
+                }
+                std::move(lo, hi, first + bucketBegin[k]);
+            } }, 1);
+    }
+}
+
+#endif
@@ -1,8 +1,23 @@
 #include "threadpool.h"
+#include "parallel.h"
 #include <iostream>
 #include <chrono>
 #include <stdexcept>
 #include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory_resource>
+#if defined(__linux__)
+#include <cerrno>
+#include <cstdlib>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 using namespace std::chrono_literals;
 
@@ -22,6 +37,32 @@ void print_pool_status(ThreadPool& pool, const std::string& title) {
               << "-------------------------\n" << std::endl;
 }
 
+// 访问线程池仅供测试使用的内部开关
+struct ThreadPoolBenchAccess {
+    static void setAlwaysNotify(ThreadPool& pool, bool always) { pool.setAlwaysNotify(always); }
+};
+
+// 统计分配量的内存资源, 用于验证线程池的内部分配都经过注入的资源
+class CountingResource : public std::pmr::memory_resource {
+public:
+    std::atomic<long> allocatedBytes{0};
+    std::atomic<long> outstandingBytes{0};
+
+private:
+    void* do_allocate(size_t bytes, size_t align) override {
+        allocatedBytes += bytes;
+        outstandingBytes += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t align) override {
+        outstandingBytes -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
 int main()
 {
     std::cout << "Main thread ID: " << std::this_thread::get_id() << std::endl;
@@ -166,6 +207,1352 @@ int main()
     }
     std::cout << "Test 3 Pool destroyed.\n";
 
+
+    // ==========================================================
+    // 测试 4: 截止时间 与 EDF 调度
+    // ==========================================================
+    std::cout << "\n=========== TEST 4: Deadlines & EDF ===========\n";
+    {
+        ThreadPool pool_edf;
+        pool_edf.setSchedulePolicy(SchedulePolicy::EDF);
+        pool_edf.start(1);
+
+        // 占住唯一的线程, 让后续任务在队列中排队
+        auto blocker = pool_edf.submitTask([] { std::this_thread::sleep_for(200ms); });
+        std::this_thread::sleep_for(20ms); // 确保 blocker 已开始执行
+
+        auto now = ThreadPool::Clock::now();
+        std::vector<int> order;
+        std::mutex orderMtx;
+        auto record = [&](int id) {
+            std::lock_guard<std::mutex> guard(orderMtx);
+            order.push_back(id);
+        };
+
+        // 按截止时间倒序提交, EDF 模式下应按截止时间正序执行
+        auto f3 = pool_edf.submitTaskWithDeadline(now + 3s, record, 3);
+        auto f2 = pool_edf.submitTaskWithDeadline(now + 2s, record, 2);
+        auto f1 = pool_edf.submitTaskWithDeadline(now + 1s, record, 1);
+        // 该任务在 blocker 结束前就会过期
+        auto fExpired = pool_edf.submitTaskWithDeadline(now + 50ms, [] {
+            log_task("EXPIRED (Should not run)");
+            return -1;
+        });
+
+        blocker.get();
+        try {
+            fExpired.get();
+            std::cout << "  FAILURE: expired task was executed!" << std::endl;
+        } catch (const TaskExpiredError& e) {
+            std::cout << "  SUCCESS: Caught expected exception: " << e.what() << std::endl;
+        }
+        f1.get(); f2.get(); f3.get();
+
+        std::cout << "  EDF execution order:";
+        for (int id : order) {
+            std::cout << " " << id;
+        }
+        std::cout << " (Expected: 1 2 3)" << std::endl;
+        std::cout << "  Expired task count: " << pool_edf.getExpiredTaskCount() << " (Expected: 1)" << std::endl;
+    }
+    std::cout << "Test 4 Pool destroyed.\n";
+
+
+    // ==========================================================
+    // 测试 5: 自旋后阻塞的空闲策略
+    // ==========================================================
+    std::cout << "\n=========== TEST 5: Spin-then-park Idle Strategy ===========\n";
+    {
+        ThreadPool pool_spin;
+        pool_spin.setIdleStrategy(2000, 50); // 自旋 2000 次, 再 yield 50 次, 然后阻塞
+        pool_spin.start(2);
+
+        // 间隔提交的小任务: 大部分应被自旋中的线程直接接手
+        long long sum = 0;
+        for (int i = 0; i < 1000; ++i) {
+            sum += pool_spin.submitTask([i] { return i; }).get();
+        }
+        std::cout << "  Sum of 0..999 computed by spinning workers: " << sum
+                  << " (Expected: 499500)" << std::endl;
+    }
+    std::cout << "Test 5 Pool destroyed.\n";
+
+
+    // ==========================================================
+    // 测试 6: 延迟启动
+    // ==========================================================
+    std::cout << "\n=========== TEST 6: Lazy Start ===========\n";
+    {
+        ThreadPool pool_lazy;
+        pool_lazy.setLazyStart(true);
+        pool_lazy.start(4);
+        std::cout << "  Threads after start(): " << pool_lazy.getCurrentThreadCount()
+                  << " (Expected: 0)" << std::endl;
+
+        std::vector<std::future<int>> futures;
+        for (int i = 0; i < 8; ++i) {
+            futures.push_back(pool_lazy.submitTask([i] {
+                std::this_thread::sleep_for(20ms);
+                return i;
+            }));
+        }
+        int sum = 0;
+        for (auto& f : futures) {
+            sum += f.get();
+        }
+        std::cout << "  Sum: " << sum << " (Expected: 28)" << std::endl;
+        std::cout << "  Threads after burst: " << pool_lazy.getCurrentThreadCount()
+                  << " (Expected: 4)" << std::endl;
+    }
+    std::cout << "Test 6 Pool destroyed.\n";
+
+
+    // ==========================================================
+    // 测试 7: 任务内存复用 与 future 生命周期
+    // ==========================================================
+    std::cout << "\n=========== TEST 7: Task Memory Recycling ===========\n";
+    {
+        std::future<std::string> outlived;
+        {
+            ThreadPool pool_mem;
+            pool_mem.start(2);
+            // 任务节点与共享状态来自线程池的内存池, 反复提交应复用相同的内存块
+            for (int i = 0; i < 1000; ++i) {
+                pool_mem.submitTask([i] { return i; }).get();
+            }
+            outlived = pool_mem.submitTask([] { return std::string("future outlives pool"); });
+        }
+        // 共享状态持有内存池的所有权, 线程池析构后仍可安全读取结果
+        std::cout << "  SUCCESS: " << outlived.get() << std::endl;
+    }
+    std::cout << "Test 7 Pool destroyed.\n";
+
+
+    // ==========================================================
+    // 测试 8: 注入 memory_resource
+    // ==========================================================
+    std::cout << "\n=========== TEST 8: Injected memory_resource ===========\n";
+    {
+        CountingResource counting;
+        {
+            ThreadPool pool_pmr(&counting);
+            pool_pmr.start(2);
+            std::vector<std::future<int>> futures;
+            for (int i = 0; i < 100; ++i) {
+                futures.push_back(pool_pmr.submitTask([i] { return i * 2; }));
+            }
+            int sum = 0;
+            for (auto& f : futures) {
+                sum += f.get();
+            }
+            std::cout << "  Sum: " << sum << " (Expected: 9900)" << std::endl;
+        }
+        std::cout << "  Bytes allocated from injected resource: " << counting.allocatedBytes
+                  << " (Expected > 0)" << std::endl;
+        std::cout << "  Bytes still outstanding after destruction: " << counting.outstandingBytes
+                  << " (Expected: 0)" << std::endl;
+    }
+    {
+        // 任务缓冲区, 亲和队列与统计分片同样来自注入的资源
+        CountingResource plain;
+        CountingResource batched;
+        {
+            ThreadPool pool_plain(&plain);
+            pool_plain.start(2);
+            ThreadPool pool_batched(&batched);
+            pool_batched.setTaskBatchSize(8);
+            pool_batched.start(2);
+        }
+        std::cout << "  Batch buffers allocated from injected resource: "
+                  << (batched.allocatedBytes > plain.allocatedBytes ? "yes" : "no") << " (Expected: yes)"
+                  << ", outstanding after destruction: " << batched.outstandingBytes << " (Expected: 0)" << std::endl;
+    }
+    std::cout << "Test 8 Pool destroyed.\n";
+
+
+    // ==========================================================
+    // 测试 9: 按内存字节数的准入控制
+    // ==========================================================
+    std::cout << "\n=========== TEST 9: Memory-bounded Admission ===========\n";
+    {
+        ThreadPool pool_bytes;
+        pool_bytes.setTaskQueMaxBytes(1 << 20); // 1 MB 预算
+        pool_bytes.start(1);
+
+        auto blocker = pool_bytes.submitTask([] { std::this_thread::sleep_for(1500ms); });
+        std::this_thread::sleep_for(20ms);
+
+        // 每个任务捕获 400 KB 的缓冲区, 并声明其占用
+        TaskOptions options;
+        options.footprint = 400 * 1024;
+        auto f1 = pool_bytes.submitTaskWithOptions(options, [buf = std::vector<char>(400 * 1024, 1)] {
+            return (int)buf.size();
+        });
+        auto f2 = pool_bytes.submitTaskWithOptions(options, [buf = std::vector<char>(400 * 1024, 2)] {
+            return (int)buf.size();
+        });
+        std::cout << "  Outstanding bytes: " << pool_bytes.getOutstandingTaskBytes()
+                  << " (Expected >= 819200)" << std::endl;
+
+        try {
+            // 第三个任务超出预算, 等待 1 秒后按 Abort 策略被拒绝
+            pool_bytes.submitTaskWithOptions(options, [buf = std::vector<char>(400 * 1024, 3)] {
+                log_task("OVER BUDGET (Should not run)");
+            });
+            std::cout << "  FAILURE: over-budget task was accepted!" << std::endl;
+        } catch (const std::runtime_error& e) {
+            std::cout << "  SUCCESS: Caught expected exception: " << e.what() << std::endl;
+        }
+
+        blocker.get();
+        std::cout << "  Results: " << f1.get() + f2.get() << " (Expected: 819200)" << std::endl;
+    }
+    {
+        // 等待预算的提交者在任务完成、字节归还时被唤醒, 而不是等到 1 秒超时
+        ThreadPool pool_wake;
+        pool_wake.setTaskQueMaxBytes(1000);
+        pool_wake.start(1);
+        TaskOptions options;
+        options.footprint = 800;
+        auto first = pool_wake.submitTaskWithOptions(options, [] { std::this_thread::sleep_for(100ms); });
+        auto begin = std::chrono::steady_clock::now();
+        auto second = pool_wake.submitTaskWithOptions(options, [] {});
+        auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+        second.get();
+        first.get();
+        std::cout << "  Woken when budget freed: " << (waited < 900ms ? "yes" : "no") << " (Expected: yes)" << std::endl;
+    }
+    std::cout << "Test 9 Pool destroyed.\n";
+
+
+    // ==========================================================
+    // 测试 10: 共享工作线程的多个执行器
+    // ==========================================================
+    std::cout << "\n=========== TEST 10: Executors sharing workers ===========\n";
+    {
+        ThreadPool pool_exec;
+        auto cpu = pool_exec.createExecutor("cpu", 3);            // 权重 3
+        auto background = pool_exec.createExecutor("background", 1); // 权重 1
+        pool_exec.start(1);
+
+        auto blocker = pool_exec.submitTask([] { std::this_thread::sleep_for(100ms); });
+        std::this_thread::sleep_for(20ms);
+
+        std::vector<std::string> order;
+        std::mutex orderMtx;
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 40; ++i) {
+            futures.push_back(cpu.submitTask([&] {
+                std::lock_guard<std::mutex> guard(orderMtx);
+                order.push_back("cpu");
+            }));
+            futures.push_back(background.submitTask([&] {
+                std::lock_guard<std::mutex> guard(orderMtx);
+                order.push_back("background");
+            }));
+        }
+        blocker.get();
+        for (auto& f : futures) {
+            f.get();
+        }
+        int cpuInFirst20 = 0;
+        for (int i = 0; i < 20; ++i) {
+            cpuInFirst20 += order[i] == "cpu";
+        }
+        std::cout << "  cpu tasks among first 20 executed: " << cpuInFirst20 << " (Expected: 15)" << std::endl;
+
+        // 并发上限: 4 个工作线程, 但 limited 同一时刻最多执行 1 个任务
+        ThreadPool pool_limit;
+        auto limited = pool_limit.createExecutor("limited", 1, 1);
+        pool_limit.start(4);
+        std::atomic<int> running{0};
+        std::atomic<int> maxRunning{0};
+        futures.clear();
+        for (int i = 0; i < 4; ++i) {
+            futures.push_back(limited.submitTask([&] {
+                int now = ++running;
+                int prev = maxRunning.load();
+                while (now > prev && !maxRunning.compare_exchange_weak(prev, now)) {}
+                std::this_thread::sleep_for(10ms);
+                --running;
+            }));
+        }
+        for (auto& f : futures) {
+            f.get();
+        }
+        std::cout << "  " << limited.getName() << " max concurrency: " << maxRunning
+                  << " (Expected: 1)" << std::endl;
+    }
+    std::cout << "Test 10 Pool destroyed.\n";
+
+    // ==========================================================
+    // 测试 11: 多租户加权公平调度
+    // ==========================================================
+    std::cout << "\n=========== TEST 11: Weighted fair queuing across tenants ===========\n";
+    {
+        ThreadPool pool_tenant;
+        pool_tenant.setTenantWeight(2, 4); // 租户 2 权重 4, 租户 1 默认权重 1
+        pool_tenant.start(1);
+
+        auto blocker = pool_tenant.submitTask([] { std::this_thread::sleep_for(100ms); });
+        std::this_thread::sleep_for(20ms);
+
+        // 租户 1 先灌入大量任务, 租户 2 之后提交的任务不应排在其后
+        std::vector<uint64_t> order;
+        std::mutex orderMtx;
+        std::vector<std::future<void>> futures;
+        for (uint64_t tenant : {1, 2}) {
+            TaskOptions options;
+            options.tenant = tenant;
+            for (int i = 0; i < 50; ++i) {
+                futures.push_back(pool_tenant.submitTaskWithOptions(options, [&, tenant] {
+                    std::lock_guard<std::mutex> guard(orderMtx);
+                    order.push_back(tenant);
+                }));
+            }
+        }
+        blocker.get();
+        for (auto& f : futures) {
+            f.get();
+        }
+        int tenant2InFirst25 = 0;
+        for (int i = 0; i < 25; ++i) {
+            tenant2InFirst25 += order[i] == 2;
+        }
+        std::cout << "  tenant 2 tasks among first 25 executed: " << tenant2InFirst25 << " (Expected: 20)" << std::endl;
+
+        TaskFlowStats stats = pool_tenant.getTenantStats(1);
+        std::cout << "  tenant 1 submitted/completed: " << stats.submitted << "/" << stats.completed
+                  << " (Expected: 50/50)" << std::endl;
+
+        // 大量一次性租户: 空闲且使用默认配置的租户队列会被回收, 设置过权重的租户保留
+        for (uint64_t tenant = 1000; tenant < 1200; ++tenant) {
+            TaskOptions options;
+            options.tenant = tenant;
+            pool_tenant.submitTaskWithOptions(options, [] {}).get();
+        }
+        TaskOptions lastOptions;
+        lastOptions.tenant = 5000;
+        pool_tenant.submitTaskWithOptions(lastOptions, [] {}).get();
+        // 回收只释放队列, 累计计数保留; 再次使用时在原计数上继续累加
+        std::cout << "  idle tenant 1000 submitted after reclaim: " << pool_tenant.getTenantStats(1000).submitted
+                  << " (Expected: 1)" << std::endl;
+        TaskOptions againOptions;
+        againOptions.tenant = 1000;
+        pool_tenant.submitTaskWithOptions(againOptions, [] {}).get();
+        TaskFlowStats again = pool_tenant.getTenantStats(1000);
+        std::cout << "  tenant 1000 submitted/completed after reuse: " << again.submitted << "/" << again.completed
+                  << " (Expected: 2/2)" << std::endl;
+        std::cout << "  weighted tenant 2 submitted after reclaim: " << pool_tenant.getTenantStats(2).submitted
+                  << " (Expected: 50)" << std::endl;
+    }
+    std::cout << "Test 11 Pool destroyed.\n";
+
+    // ==========================================================
+    // 测试 12: 阻塞任务专用线程池与阻塞区域
+    // ==========================================================
+    std::cout << "\n=========== TEST 12: Blocking lane and blocking regions ===========\n";
+    {
+        ThreadPool pool_io;
+        pool_io.setBlockingCompensationThreshHold(1);
+        pool_io.start(1); // 只有一个计算线程
+        std::cout << "  thread slots: " << pool_io.getMaxThreadCount() << " (Expected: 2)" << std::endl;
+
+        // 4 个阻塞任务互相等待, 只有在 I/O 线程池中并发执行时才能全部完成
+        std::atomic<int> arrived{0};
+        std::vector<std::future<bool>> blocking;
+        for (int i = 0; i < 4; ++i) {
+            blocking.push_back(pool_io.submitBlocking([&] {
+                ++arrived;
+                auto until = std::chrono::steady_clock::now() + 2s;
+                while (arrived < 4 && std::chrono::steady_clock::now() < until) {
+                    std::this_thread::sleep_for(1ms);
+                }
+                return arrived == 4;
+            }));
+        }
+        // 阻塞任务执行期间计算线程仍可用
+        std::cout << "  cpu task while blocking tasks run: " << pool_io.submitTask([] { return 42; }).get()
+                  << " (Expected: 42)" << std::endl;
+        int concurrent = 0;
+        for (auto& f : blocking) {
+            concurrent += f.get();
+        }
+        std::cout << "  blocking tasks that ran concurrently: " << concurrent << " (Expected: 4)" << std::endl;
+        std::cout << "  compute threads: " << pool_io.getCurrentThreadCount() << " (Expected: 1)" << std::endl;
+
+        // 唯一的计算线程在阻塞区域内等待后提交的任务, 由补偿线程执行
+        auto outer = pool_io.submitTask([&pool_io] {
+            auto inner = pool_io.submitTask([] { return 7; });
+            ThreadPool::BlockingRegion region;
+            if (inner.wait_for(2s) != std::future_status::ready) {
+                return -1;
+            }
+            return inner.get();
+        });
+        std::cout << "  inner result via compensating worker: " << outer.get() << " (Expected: 7)" << std::endl;
+        std::this_thread::sleep_for(20ms);
+        std::cout << "  compute threads after region: " << pool_io.getCurrentThreadCount() << " (Expected: 1)" << std::endl;
+    }
+    std::cout << "Test 12 Pool destroyed.\n";
+
+#if defined(__linux__)
+    // ==========================================================
+    // 测试 13: 异步文件 I/O
+    // ==========================================================
+    std::cout << "\n=========== TEST 13: Asynchronous file I/O ===========\n";
+    {
+        ThreadPool pool_aio;
+        pool_aio.start(2);
+        std::cout << "  io_uring enabled: " << (pool_aio.isIoUringEnabled() ? "yes" : "no (pread/pwrite fallback)") << std::endl;
+
+        char path[] = "/tmp/threadpool_aio_XXXXXX";
+        int fd = mkstemp(path);
+        unlink(path);
+
+        // 分 8 块并发写入, 再读回
+        const size_t blockSize = 4096;
+        std::vector<char> data(8 * blockSize);
+        for (size_t i = 0; i < data.size(); ++i) {
+            data[i] = (char)('a' + i % 26);
+        }
+        std::vector<std::future<long>> writes;
+        for (size_t b = 0; b < 8; ++b) {
+            writes.push_back(pool_aio.writeAsync(fd, data.data() + b * blockSize, blockSize, (int64_t)(b * blockSize)));
+        }
+        long written = 0;
+        for (auto& f : writes) {
+            written += f.get();
+        }
+        std::cout << "  bytes written: " << written << " (Expected: " << data.size() << ")" << std::endl;
+
+        std::vector<char> readBack(data.size());
+        std::cout << "  bytes read: " << pool_aio.readAsync(fd, readBack.data(), readBack.size(), 0).get()
+                  << " (Expected: " << data.size() << ")" << std::endl;
+        std::cout << "  content matches: " << (readBack == data ? "yes" : "no") << " (Expected: yes)" << std::endl;
+
+        // 回调作为任务在工作线程中执行
+        std::promise<bool> onWorker;
+        auto mainId = std::this_thread::get_id();
+        pool_aio.readAsync(fd, readBack.data(), blockSize, 0, [&](long n) {
+            onWorker.set_value(n == (long)blockSize && std::this_thread::get_id() != mainId);
+        });
+        std::cout << "  callback ran as pool task: " << (onWorker.get_future().get() ? "yes" : "no")
+                  << " (Expected: yes)" << std::endl;
+
+        std::cout << "  read from bad fd: " << pool_aio.readAsync(-1, readBack.data(), blockSize, 0).get()
+                  << " (Expected: " << -EBADF << ")" << std::endl;
+        close(fd);
+
+        // 永远不会就绪的管道读: 析构时取消, future 得到 -ECANCELED 而不是卡住关闭
+        if (pool_aio.isIoUringEnabled()) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+                throw std::runtime_error("pipe failed");
+            }
+            char pipeBuf[16];
+            std::future<long> pending;
+            auto begin = std::chrono::steady_clock::now();
+            {
+                ThreadPool pool_pipe;
+                pool_pipe.start(2);
+                pending = pool_pipe.readAsync(fds[0], pipeBuf, sizeof(pipeBuf), -1);
+            }
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+            std::cout << "  pending pipe read result after destruction: " << pending.get()
+                      << " (Expected: " << -ECANCELED << ")" << std::endl;
+            std::cout << "  destruction finished quickly: " << (ms < 1000 ? "yes" : "no") << " (Expected: yes)" << std::endl;
+            close(fds[0]);
+            close(fds[1]);
+        }
+    }
+    std::cout << "Test 13 Pool destroyed.\n";
+
+    // ==========================================================
+    // 测试 14: epoll 事件循环
+    // ==========================================================
+    std::cout << "\n=========== TEST 14: epoll reactor driven by workers ===========\n";
+    {
+        ThreadPool pool_reactor;
+        pool_reactor.start(1); // 唯一的工作线程既要处理 fd 事件也要执行任务
+
+        int fds[2];
+        if (pipe(fds) != 0) {
+            throw std::runtime_error("pipe failed");
+        }
+        std::atomic<int> bytesRead{0};
+        std::atomic<bool> onWorker{true};
+        auto mainId = std::this_thread::get_id();
+        pool_reactor.addFd(fds[0], EPOLLIN, [&](uint32_t) {
+            char buf[64];
+            ssize_t n = read(fds[0], buf, sizeof(buf));
+            if (n > 0) {
+                bytesRead += (int)n;
+            }
+            onWorker = onWorker && std::this_thread::get_id() != mainId;
+        });
+
+        for (int i = 0; i < 3; ++i) {
+            std::this_thread::sleep_for(20ms);
+            ssize_t n = write(fds[1], "ping", 4);
+            (void)n;
+        }
+        auto until = std::chrono::steady_clock::now() + 2s;
+        while (bytesRead < 12 && std::chrono::steady_clock::now() < until) {
+            std::this_thread::sleep_for(1ms);
+        }
+        std::cout << "  bytes handled by reactor: " << bytesRead << " (Expected: 12)" << std::endl;
+        std::cout << "  handled on worker thread: " << (onWorker ? "yes" : "no") << " (Expected: yes)" << std::endl;
+
+        // 工作线程阻塞在 epoll 上时, 提交任务通过 eventfd 唤醒它
+        std::this_thread::sleep_for(20ms);
+        auto f = pool_reactor.submitTask([] { return 5; });
+        std::cout << "  task while leader waits: "
+                  << (f.wait_for(2s) == std::future_status::ready ? f.get() : -1) << " (Expected: 5)" << std::endl;
+
+        pool_reactor.removeFd(fds[0]);
+        close(fds[0]);
+        close(fds[1]);
+    }
+    {
+        // 长时间运行的 handler 不算空闲: 期间提交的任务在 cached 模式下由新线程执行
+        ThreadPool pool_leader;
+        pool_leader.setMode(PoolMode::MODE_CACHED);
+        pool_leader.start(1);
+
+        int fds[2];
+        if (pipe(fds) != 0) {
+            throw std::runtime_error("pipe failed");
+        }
+        std::promise<void> handlerEntered;
+        std::atomic<bool> entered{false};
+        pool_leader.addFd(fds[0], EPOLLIN, [&](uint32_t) {
+            char buf[8];
+            ssize_t n = read(fds[0], buf, sizeof(buf));
+            (void)n;
+            if (!entered.exchange(true)) {
+                handlerEntered.set_value();
+            }
+            std::this_thread::sleep_for(500ms);
+        });
+        std::this_thread::sleep_for(20ms);
+        ssize_t n = write(fds[1], "x", 1);
+        (void)n;
+        handlerEntered.get_future().wait();
+        auto f = pool_leader.submitTask([] { return 9; });
+        std::cout << "  task while handler runs: "
+                  << (f.wait_for(300ms) == std::future_status::ready ? f.get() : -1) << " (Expected: 9)" << std::endl;
+
+        pool_leader.removeFd(fds[0]);
+        close(fds[0]);
+        close(fds[1]);
+    }
+    {
+        // 同时就绪的多个 fd 在队列已满时由 leader 就地处理, 不等待空位也不触发 Abort;
+        // handler 抛出非 std::exception 的异常不会终止进程
+        ThreadPool pool_burst;
+        pool_burst.setTaskQueMaxThreshHold(1);
+        pool_burst.setPolicy(RejectionPolicy::Abort);
+        pool_burst.start(1);
+
+        const int pipeCount = 4;
+        int fds[pipeCount][2];
+        std::atomic<int> handled{0};
+        for (auto& p : fds) {
+            if (pipe(p) != 0) {
+                throw std::runtime_error("pipe failed");
+            }
+            int readFd = p[0];
+            pool_burst.addFd(readFd, EPOLLIN, [&handled, readFd](uint32_t) {
+                char buf[8];
+                ssize_t n = read(readFd, buf, sizeof(buf));
+                (void)n;
+                handled++;
+                throw 42;
+            });
+        }
+        // 先占住唯一的工作线程, 让所有 fd 在它回到 epoll 之前就绪
+        std::atomic<bool> release{false};
+        auto busy = pool_burst.submitTask([&] {
+            while (!release) {
+                std::this_thread::sleep_for(1ms);
+            }
+        });
+        std::this_thread::sleep_for(20ms);
+        for (auto& p : fds) {
+            ssize_t n = write(p[1], "x", 1);
+            (void)n;
+        }
+        auto begin = std::chrono::steady_clock::now();
+        release = true;
+        busy.get();
+        while (handled < pipeCount && std::chrono::steady_clock::now() - begin < 3s) {
+            std::this_thread::sleep_for(1ms);
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << "  burst handled with full queue: " << handled << " (Expected: " << pipeCount << ")"
+                  << ", within 500ms: " << (ms < 500 ? "yes" : "no") << " (Expected: yes)" << std::endl;
+
+        for (auto& p : fds) {
+            pool_burst.removeFd(p[0]);
+            close(p[0]);
+            close(p[1]);
+        }
+    }
+    std::cout << "Test 14 Pool destroyed.\n";
+#endif
+
+    // ==========================================================
+    // 测试 15: 并行算法
+    // ==========================================================
+    std::cout << "\n=========== TEST 15: Parallel algorithms on pool.par() ===========\n";
+    {
+        ThreadPool pool_par;
+        pool_par.start(4);
+
+        std::vector<long long> v(100000);
+        parallel::for_each(pool_par.par(), v.begin(), v.end(), [](long long& x) { x = 1; });
+        std::vector<long long> prefix(v.size());
+        parallel::inclusive_scan(pool_par.par(), v.begin(), v.end(), prefix.begin());
+        std::cout << "  inclusive_scan last: " << prefix.back() << " (Expected: 100000)" << std::endl;
+
+        std::vector<long long> idx(v.size());
+        parallel::exclusive_scan(pool_par.par(), v.begin(), v.end(), idx.begin(), 0LL);
+        std::vector<long long> squares(v.size());
+        parallel::transform(pool_par.par(), idx.begin(), idx.end(), squares.begin(), [](long long x) { return x * x % 1000; });
+        long long sum = parallel::reduce(pool_par.par(), squares.begin(), squares.end(), 0LL);
+        long long expectedSum = 0;
+        for (long long i = 0; i < 100000; ++i) {
+            expectedSum += i * i % 1000;
+        }
+        std::cout << "  reduce matches serial: " << (sum == expectedSum ? "yes" : "no") << " (Expected: yes)" << std::endl;
+        std::cout << "  dot product: " << parallel::transform_reduce(pool_par.par(), v.begin(), v.end(), v.begin(), 0LL)
+                  << " (Expected: 100000)" << std::endl;
+
+        std::vector<long long> evens(idx.size());
+        auto evensEnd = parallel::copy_if(pool_par.par(), idx.begin(), idx.end(), evens.begin(),
+                                          [](long long x) { return x % 2 == 0; });
+        evens.erase(evensEnd, evens.end());
+        std::cout << "  copy_if kept in order: "
+                  << (evens.size() == 50000 && std::is_sorted(evens.begin(), evens.end()) ? "yes" : "no")
+                  << " (Expected: yes)" << std::endl;
+
+        std::vector<int> data(200000);
+        unsigned seed = 12345;
+        for (auto& x : data) {
+            seed = seed * 1103515245 + 12345;
+            x = (int)(seed >> 8);
+        }
+        std::vector<int> expected = data;
+        std::sort(expected.begin(), expected.end());
+        parallel::sort(pool_par.par(), data.begin(), data.end());
+        std::cout << "  sort matches std::sort: " << (data == expected ? "yes" : "no") << " (Expected: yes)" << std::endl;
+
+        std::vector<int> merged(2 * expected.size());
+        parallel::merge(pool_par.par(), expected.begin(), expected.end(), data.begin(), data.end(), merged.begin());
+        std::cout << "  merge sorted: " << (std::is_sorted(merged.begin(), merged.end()) ? "yes" : "no")
+                  << " (Expected: yes)" << std::endl;
+
+        // 在单线程池的任务中调用: 调用者参与计算, 不会死锁
+        ThreadPool pool_nested;
+        pool_nested.start(1);
+        auto nested = pool_nested.submitTask([&pool_nested] {
+            std::vector<int> inner(10000, 2);
+            return parallel::reduce(pool_nested.par(), inner.begin(), inner.end(), 0);
+        });
+        std::cout << "  nested reduce: " << (nested.wait_for(5s) == std::future_status::ready ? nested.get() : -1)
+                  << " (Expected: 20000)" << std::endl;
+
+        // 异常传播到调用者
+        bool caught = false;
+        try {
+            parallel::for_each(pool_par.par(1000), v.begin(), v.end(), [](long long&) { throw std::runtime_error("boom"); });
+        } catch (const std::runtime_error&) {
+            caught = true;
+        }
+        std::cout << "  exception propagated: " << (caught ? "yes" : "no") << " (Expected: yes)" << std::endl;
+
+        // 扫描只依赖结合律: 字符串拼接不满足交换律, 结果仍须保持原顺序
+        std::vector<std::string> letters(26 * 40);
+        for (size_t i = 0; i < letters.size(); ++i) {
+            letters[i] = std::string(1, (char)('a' + i % 26));
+        }
+        std::vector<std::string> joined(letters.size());
+        parallel::inclusive_scan(pool_par.par(26), letters.begin(), letters.end(), joined.begin());
+        std::string expectedJoined;
+        for (const auto& l : letters) {
+            expectedJoined += l;
+        }
+        std::cout << "  non-commutative scan keeps order: " << (joined.back() == expectedJoined ? "yes" : "no")
+                  << " (Expected: yes)" << std::endl;
+    }
+    {
+        // 队列已满时 parallelFor 不等待空位, 由调用者完成剩余的块
+        ThreadPool pool_full;
+        pool_full.setTaskQueMaxThreshHold(1);
+        pool_full.start(1);
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        auto blocker = pool_full.submitTask([released] { released.wait(); });
+        std::this_thread::sleep_for(20ms);
+        auto filler = pool_full.submitTask([] {});
+        std::atomic<size_t> covered{0};
+        auto begin = std::chrono::steady_clock::now();
+        pool_full.parallelFor(0, 1000, [&](size_t lo, size_t hi) { covered += hi - lo; }, 100);
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << "  parallelFor with full queue covered: " << covered << " (Expected: 1000)" << std::endl;
+        std::cout << "  parallelFor did not wait for queue space: " << (ms < 500 ? "yes" : "no") << " (Expected: yes)" << std::endl;
+        release.set_value();
+        blocker.get();
+        filler.get();
+    }
+    std::cout << "Test 15 Pool destroyed.\n";
+
+    // ==========================================================
+    // 测试 16: 大数组并行排序 (样本排序) 与稳定排序
+    // ==========================================================
+    std::cout << "\n=========== TEST 16: Parallel sample sort ===========\n";
+    {
+        ThreadPool pool_sort;
+        pool_sort.start(2);
+
+        // 两个任务同时占满全部工作线程, 各自在任务内调用并行排序
+        std::vector<std::future<bool>> sorts;
+        for (unsigned seed : {1u, 2u}) {
+            sorts.push_back(pool_sort.submitTask([&pool_sort, seed] {
+                std::vector<unsigned> v(1 << 18);
+                unsigned x = seed;
+                for (auto& e : v) {
+                    x = x * 1664525u + 1013904223u;
+                    e = x % 1000; // 大量重复值
+                }
+                parallel::sort(pool_sort.par(), v.begin(), v.end());
+                return std::is_sorted(v.begin(), v.end());
+            }));
+        }
+        int sortedCount = 0;
+        for (auto& f : sorts) {
+            sortedCount += f.wait_for(10s) == std::future_status::ready && f.get();
+        }
+        std::cout << "  sorts finished inside tasks: " << sortedCount << " (Expected: 2)" << std::endl;
+
+        std::vector<std::pair<int, int>> records(5000);
+        for (int i = 0; i < 5000; ++i) {
+            records[i] = {i * 7 % 10, i};
+        }
+        parallel::stable_sort(pool_sort.par(), records.begin(), records.end(),
+                              [](const auto& a, const auto& b) { return a.first < b.first; });
+        bool stable = std::is_sorted(records.begin(), records.end()); // 键相同时原下标仍递增
+        std::cout << "  stable_sort keeps equal keys in order: " << (stable ? "yes" : "no") << " (Expected: yes)" << std::endl;
+
+        // 元素类型不可默认构造, 比较器按值接收参数: 比较不能从元素移动构造
+        struct Keyed {
+            explicit Keyed(int k) : key(k), tag(std::to_string(k)) {}
+            int key;
+            std::string tag;
+        };
+        auto byValue = [](Keyed a, Keyed b) { return a.key < b.key; };
+        for (size_t count : {size_t(5000), size_t(1) << 17}) {
+            std::vector<Keyed> keyed;
+            keyed.reserve(count);
+            unsigned x = 7;
+            for (size_t i = 0; i < count; ++i) {
+                x = x * 1664525u + 1013904223u;
+                keyed.emplace_back((int)(x % 100000));
+            }
+            parallel::sort(pool_sort.par(), keyed.begin(), keyed.end(), byValue);
+            bool intact = std::is_sorted(keyed.begin(), keyed.end(), byValue) &&
+                          std::all_of(keyed.begin(), keyed.end(), [](const Keyed& k) { return k.tag == std::to_string(k.key); });
+            std::cout << "  sort of " << count << " non-default-constructible elements intact: " << (intact ? "yes" : "no")
+                      << " (Expected: yes)" << std::endl;
+        }
+    }
+    std::cout << "Test 16 Pool destroyed.\n";
+
+    // ==========================================================
+    // 测试 17: 嵌套提交与 help-first 等待
+    // ==========================================================
+    std::cout << "\n=========== TEST 17: Nested submission with help-first waiting ===========\n";
+    {
+        ThreadPool pool_nest;
+        pool_nest.start(2);
+
+        // 两个外层任务占满两个工作线程, 各自提交内层任务并等待结果
+        std::vector<TaskFuture<int>> outers;
+        for (int i = 0; i < 2; ++i) {
+            outers.push_back(pool_nest.submitTask([&pool_nest, i] {
+                std::this_thread::sleep_for(20ms); // 保证两个外层任务同时在执行
+                auto inner = pool_nest.submitTask([i] { return i + 10; });
+                return inner.get();
+            }));
+        }
+        int total = 0;
+        for (auto& f : outers) {
+            total += f.wait_for(5s) == std::future_status::ready ? f.get() : -100;
+        }
+        std::cout << "  nested results sum: " << total << " (Expected: 21)" << std::endl;
+
+        // 递归分治
+        std::function<long(int)> fib = [&](int n) -> long {
+            if (n < 2) {
+                return n;
+            }
+            auto left = pool_nest.submitTask(fib, n - 1);
+            long right = fib(n - 2);
+            return left.get() + right;
+        };
+        auto root = pool_nest.submitTask(fib, 15);
+        std::cout << "  recursive fib(15): " << (root.wait_for(10s) == std::future_status::ready ? root.get() : -1)
+                  << " (Expected: 610)" << std::endl;
+
+        bool fromWorker = pool_nest.submitTask([&pool_nest] { return pool_nest.isWorkerThread(); }).get();
+        std::cout << "  isWorkerThread in task / caller: " << fromWorker << " / " << pool_nest.isWorkerThread()
+                  << " (Expected: 1 / 0)" << std::endl;
+    }
+    std::cout << "Test 17 Pool destroyed.\n";
+
+    // ==========================================================
+    // 测试 18: 工作线程下标与 WorkerLocal
+    // ==========================================================
+    std::cout << "\n=========== TEST 18: Worker index and WorkerLocal ===========\n";
+    {
+        ThreadPool pool_local;
+        pool_local.start(4);
+
+        std::atomic<bool> indexInRange{true};
+        WorkerLocal<long> counts(pool_local, 0);
+        pool_local.parallelFor(0, 100000, [&](size_t lo, size_t hi) {
+            int index = ThreadPool::currentWorkerIndex();
+            if (pool_local.isWorkerThread() && (index < 0 || index >= pool_local.getMaxThreadCount())) {
+                indexInRange = false;
+            }
+            counts.local() += (long)(hi - lo); // 无锁累加
+        }, 1000);
+        std::cout << "  combined count: " << counts.combine(0L, std::plus<long>()) << " (Expected: 100000)" << std::endl;
+        std::cout << "  worker indices in range: " << (indexInRange ? "yes" : "no") << " (Expected: yes)" << std::endl;
+        std::cout << "  index outside pool: " << ThreadPool::currentWorkerIndex() << " (Expected: -1)" << std::endl;
+    }
+    std::cout << "Test 18 Pool destroyed.\n";
+
+    // ==========================================================
+    // 测试 19: 批量取任务
+    // ==========================================================
+    std::cout << "\n=========== TEST 19: Batched dequeue ===========\n";
+    {
+        ThreadPool pool_batch;
+        pool_batch.setTaskBatchSize(16);
+        pool_batch.start(4);
+
+        std::atomic<long> sum{0};
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 20000; ++i) {
+            futures.push_back(pool_batch.submitTask([&sum, i] { sum += i; }));
+        }
+        for (auto& f : futures) {
+            f.get();
+        }
+        std::cout << "  sum of micro tasks: " << sum << " (Expected: 199990000)" << std::endl;
+        std::cout << "  tasks left in queue and buffers: " << pool_batch.getTaskQueueSize() << " (Expected: 0)" << std::endl;
+
+        // 嵌套等待的子任务可能位于自己的缓冲区中
+        std::function<long(int)> fib = [&](int n) -> long {
+            if (n < 2) {
+                return n;
+            }
+            auto left = pool_batch.submitTask(fib, n - 1);
+            long right = fib(n - 2);
+            return left.get() + right;
+        };
+        auto root = pool_batch.submitTask(fib, 15);
+        std::cout << "  recursive fib(15) with batching: "
+                  << (root.wait_for(10s) == std::future_status::ready ? root.get() : -1) << " (Expected: 610)" << std::endl;
+    }
+    {
+        // 缓冲区中的任务计入队列上限: 唯一的线程取走 1 个任务并缓冲 3 个后, 容量 4 只剩 1 个空位
+        ThreadPool pool_batch_bound;
+        pool_batch_bound.setTaskBatchSize(8);
+        pool_batch_bound.setTaskQueMaxThreshHold(4);
+        pool_batch_bound.setPolicy(RejectionPolicy::Discard);
+        pool_batch_bound.start(1);
+
+        std::atomic<int> ran{0};
+        std::atomic<bool> release[2] = {{false}, {false}};
+        std::atomic<bool> entered[2] = {{false}, {false}};
+        auto gate = [&](int g) {
+            entered[g] = true;
+            while (!release[g]) {
+                std::this_thread::sleep_for(1ms);
+            }
+            ran++;
+        };
+        pool_batch_bound.submitTask(gate, 0);
+        while (!entered[0]) {
+            std::this_thread::sleep_for(1ms);
+        }
+        pool_batch_bound.submitTask(gate, 1); // 下一个被取出执行的任务, 其后 3 个进入缓冲区
+        for (int i = 0; i < 3; ++i) {
+            pool_batch_bound.submitTask([&ran] { ran++; });
+        }
+        release[0] = true;
+        while (!entered[1]) {
+            std::this_thread::sleep_for(1ms);
+        }
+        for (int i = 0; i < 3; ++i) {
+            pool_batch_bound.submitTask([&ran] { ran++; });
+        }
+        release[1] = true;
+        while (pool_batch_bound.getTaskQueueSize() > 0) {
+            std::this_thread::sleep_for(1ms);
+        }
+        std::this_thread::sleep_for(20ms);
+        std::cout << "  tasks run with 3 buffered and bound 4: " << ran << " (Expected: 6)" << std::endl;
+    }
+    std::cout << "Test 19 Pool destroyed.\n";
+
+    std::cout << "\n=========== TEST 20: Affinity submission ===========\n";
+    {
+        ThreadPool pool_aff;
+        pool_aff.setAffinityStealThreshHold(0); // 从不窃取: 同一 key 的任务串行执行
+        pool_aff.start(4);
+
+        // 每个分片的状态不加锁, 只由首选线程访问
+        const int shards = 8;
+        std::vector<std::vector<int>> shardLog(shards);
+        std::vector<int> shardWorker(shards, -1);
+        std::atomic<int> wrongWorker{0};
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 4000; ++i) {
+            int key = i % shards;
+            futures.push_back(pool_aff.submitWithAffinity(key, [&, key, i] {
+                int worker = ThreadPool::currentWorkerIndex();
+                if (shardWorker[key] == -1) {
+                    shardWorker[key] = worker;
+                } else if (shardWorker[key] != worker) {
+                    wrongWorker++;
+                }
+                shardLog[key].push_back(i);
+            }));
+        }
+        for (auto& f : futures) {
+            f.get();
+        }
+        bool ordered = true;
+        for (auto& log : shardLog) {
+            ordered = ordered && log.size() == 500 && std::is_sorted(log.begin(), log.end());
+        }
+        std::cout << "  tasks run off their preferred worker: " << wrongWorker << " (Expected: 0)" << std::endl;
+        std::cout << "  per-key FIFO order kept: " << (ordered ? "yes" : "no") << " (Expected: yes)" << std::endl;
+        std::cout << "  affinity result: " << pool_aff.submitWithAffinity(std::string("conn-42"), [](int x) { return x * 2; }, 21).get()
+                  << " (Expected: 42)" << std::endl;
+    }
+    {
+        // 首选线程被长任务占住时, 过载的队列由其他线程窃取
+        ThreadPool pool_steal;
+        pool_steal.setAffinityStealThreshHold(2);
+        pool_steal.start(2);
+
+        std::atomic<bool> release{false};
+        std::atomic<int> stolenRuns{0};
+        auto blocker = pool_steal.submitWithAffinity(0, [&] {
+            while (!release) {
+                std::this_thread::sleep_for(1ms);
+            }
+            return ThreadPool::currentWorkerIndex();
+        });
+        std::this_thread::sleep_for(50ms);
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 10; ++i) {
+            futures.push_back(pool_steal.submitWithAffinity(0, [&] { stolenRuns++; }));
+        }
+        auto deadline = std::chrono::steady_clock::now() + 5s;
+        while (stolenRuns < 8 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(1ms);
+        }
+        std::cout << "  tasks stolen while preferred worker busy: " << stolenRuns << " (Expected: 8)" << std::endl;
+        release = true;
+        blocker.get();
+        for (auto& f : futures) {
+            f.get();
+        }
+        std::cout << "  all affinity tasks finished: " << stolenRuns << " (Expected: 10)" << std::endl;
+    }
+    {
+        // 亲和队列中的任务计入队列上限, 超出时同样应用拒绝策略
+        ThreadPool pool_bound;
+        pool_bound.setAffinityStealThreshHold(0);
+        pool_bound.setTaskQueMaxThreshHold(2);
+        pool_bound.setPolicy(RejectionPolicy::Discard);
+        pool_bound.start(1);
+
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        auto blocker = pool_bound.submitWithAffinity(0, [released] { released.wait(); });
+        std::this_thread::sleep_for(20ms);
+        std::atomic<int> ran{0};
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 4; ++i) {
+            futures.push_back(pool_bound.submitWithAffinity(0, [&] { ran++; }));
+        }
+        uint64_t discarded = pool_bound.getStats().discarded;
+        std::cout << "  affinity tasks discarded over the bound: " << discarded << " (Expected: 2)" << std::endl;
+
+        // 等待空位的提交者在亲和任务被取走时被唤醒, 而不是等满 1 秒
+        auto begin = std::chrono::steady_clock::now();
+        std::thread releaser([&] {
+            std::this_thread::sleep_for(100ms);
+            release.set_value();
+        });
+        auto late = pool_bound.submitWithAffinity(0, [&] { ran++; });
+        auto waitedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+        releaser.join();
+        late.get();
+        blocker.get();
+        std::cout << "  producer woken when an affinity slot frees: " << (waitedMs < 900 ? "yes" : "no")
+                  << " (Expected: yes)" << std::endl;
+        std::cout << "  accepted affinity tasks ran: " << ran << " (Expected: 3)" << std::endl;
+    }
+    {
+        // cached 模式: 亲和队列积压超过窃取阈值时与普通提交一样增加线程, 新线程窃取积压的任务
+        ThreadPool pool_aff_cached;
+        pool_aff_cached.setMode(PoolMode::MODE_CACHED);
+        pool_aff_cached.setAffinityStealThreshHold(2);
+        pool_aff_cached.start(1);
+
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 10; ++i) {
+            futures.push_back(pool_aff_cached.submitWithAffinity(0, [] { std::this_thread::sleep_for(100ms); }));
+        }
+        int grownTo = pool_aff_cached.getCurrentThreadCount();
+        for (auto& f : futures) {
+            f.get();
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << "  cached pool grew for affinity backlog: " << (grownTo > 1 ? "yes" : "no") << " (Expected: yes)"
+                  << ", finished faster than serial: " << (ms < 900 ? "yes" : "no") << " (Expected: yes)" << std::endl;
+    }
+    std::cout << "Test 20 Pool destroyed.\n";
+
+    std::cout << "\n=========== TEST 21: Strand ===========\n";
+    {
+        ThreadPool pool_strand;
+        pool_strand.start(4);
+
+        // 多个线程同时向少量 Strand 投递, 任务内不加锁
+        struct Session {
+            std::vector<int> log;
+            std::atomic<int> inside{0};
+            int overlaps = 0;
+        };
+        const int sessions = 4;
+        std::vector<Session> state(sessions);
+        std::vector<ThreadPool::Strand> strands;
+        for (int i = 0; i < sessions; ++i) {
+            strands.push_back(pool_strand.createStrand());
+        }
+        std::vector<std::thread> producers;
+        for (int p = 0; p < 2; ++p) {
+            producers.emplace_back([&, p] {
+                for (int i = 0; i < 5000; ++i) {
+                    int s = i % sessions;
+                    strands[s].post([&state, s, p, i] {
+                        Session& session = state[s];
+                        if (session.inside.fetch_add(1) != 0) {
+                            session.overlaps++;
+                        }
+                        session.log.push_back(p * 100000 + i);
+                        session.inside.fetch_sub(1);
+                    });
+                }
+            });
+        }
+        for (auto& t : producers) {
+            t.join();
+        }
+        auto last = strands[0].post([] { return 7; });
+        std::cout << "  value from strand: " << last.get() << " (Expected: 7)" << std::endl;
+        for (auto& strand : strands) {
+            strand.post([] {}).get();
+        }
+
+        int overlaps = 0;
+        bool fifo = true;
+        size_t total = 0;
+        for (auto& session : state) {
+            overlaps += session.overlaps;
+            total += session.log.size();
+            // 同一生产者投递的任务保持投递顺序
+            int lastSeen[2] = {-1, -1};
+            for (int v : session.log) {
+                int producer = v / 100000;
+                fifo = fifo && v % 100000 > lastSeen[producer];
+                lastSeen[producer] = v % 100000;
+            }
+        }
+        std::cout << "  concurrent runs within a strand: " << overlaps << " (Expected: 0)" << std::endl;
+        std::cout << "  tasks run: " << total << " (Expected: 10000), FIFO per producer: " << (fifo ? "yes" : "no") << " (Expected: yes)" << std::endl;
+
+        // 大量 Strand: 空闲时不占用线程
+        std::vector<ThreadPool::Strand> many;
+        std::vector<int> counters(100000, 0);
+        for (int i = 0; i < 100000; ++i) {
+            many.push_back(pool_strand.createStrand());
+        }
+        std::vector<std::future<void>> futures;
+        for (int round = 0; round < 3; ++round) {
+            for (int i = 0; i < 100000; ++i) {
+                futures.push_back(many[i].post([&counters, i] { counters[i]++; }));
+            }
+        }
+        for (auto& f : futures) {
+            f.get();
+        }
+        bool allThree = std::all_of(counters.begin(), counters.end(), [](int c) { return c == 3; });
+        std::cout << "  100000 strands, 3 tasks each completed: " << (allThree ? "yes" : "no") << " (Expected: yes)" << std::endl;
+    }
+    {
+        // Strand 内的任务与普通任务一样计入统计; 关闭后投递在链接节点之前被拒绝
+        ThreadPool pool_strand_stats;
+        pool_strand_stats.start(1);
+        ThreadPool::Strand strand = pool_strand_stats.createStrand();
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 100; ++i) {
+            futures.push_back(strand.post([] {}));
+        }
+        for (auto& f : futures) {
+            f.get();
+        }
+        std::this_thread::sleep_for(20ms);
+        PoolStats stats = pool_strand_stats.getStats();
+#if THREADPOOL_STATS
+        std::cout << "  strand tasks in run-time histogram: " << (stats.runTime.count() >= 100 ? "yes" : "no")
+                  << " (Expected: yes)" << std::endl;
+        std::cout << "  submitted equals completed: " << (stats.submitted == stats.completed ? "yes" : "no")
+                  << " (Expected: yes)" << std::endl;
+#endif
+        pool_strand_stats.shutdown();
+        bool rejected = false;
+        try {
+            strand.post([] {});
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        std::cout << "  post after shutdown rejected, strand idle: "
+                  << (rejected && strand.getPendingTaskCount() == 0 ? "yes" : "no") << " (Expected: yes)" << std::endl;
+    }
+    std::cout << "Test 21 Pool destroyed.\n";
+
+    std::cout << "\n=========== TEST 22: Cache topology ===========\n";
+    {
+        auto groups = ThreadPool::readCacheTopology();
+        size_t cpus = 0;
+        bool nonEmpty = !groups.empty();
+        for (auto& group : groups) {
+            nonEmpty = nonEmpty && !group.empty();
+            cpus += group.size();
+        }
+        std::cout << "  L3 groups: " << groups.size() << ", cpus: " << cpus
+                  << ", all groups non-empty: " << (nonEmpty ? "yes" : "no") << " (Expected: yes)" << std::endl;
+
+        ThreadPool pool_topo;
+        pool_topo.setTopologyAware(true);
+        pool_topo.setTaskBatchSize(8);
+        pool_topo.setAffinityStealThreshHold(2);
+        pool_topo.start(4);
+
+        bool groupsValid = pool_topo.getTopologyGroupCount() == (int)groups.size();
+        for (int i = 0; i < pool_topo.getMaxThreadCount(); ++i) {
+            int group = pool_topo.getWorkerGroup(i);
+            groupsValid = groupsValid && group >= 0 && group < pool_topo.getTopologyGroupCount() &&
+                          std::find(groups[group].begin(), groups[group].end(), pool_topo.getWorkerCpu(i)) != groups[group].end();
+        }
+        std::cout << "  every worker bound to a cpu of its group: " << (groupsValid ? "yes" : "no") << " (Expected: yes)" << std::endl;
+
+#if defined(__linux__)
+        std::atomic<int> wrongCpu{0};
+        std::vector<std::future<void>> pinned;
+        for (int i = 0; i < 100; ++i) {
+            pinned.push_back(pool_topo.submitTask([&] {
+                if (sched_getcpu() != pool_topo.getWorkerCpu(ThreadPool::currentWorkerIndex())) {
+                    wrongCpu++;
+                }
+            }));
+        }
+        for (auto& f : pinned) {
+            f.get();
+        }
+        std::cout << "  tasks run off their worker's cpu: " << wrongCpu << " (Expected: 0)" << std::endl;
+#endif
+
+        // 批量缓冲区与亲和队列的窃取按分组顺序进行
+        std::function<long(int)> fib = [&](int n) -> long {
+            if (n < 2) {
+                return n;
+            }
+            auto left = pool_topo.submitWithAffinity(ThreadPool::currentWorkerIndex(), fib, n - 1);
+            long right = fib(n - 2);
+            return left.get() + right;
+        };
+        auto root = pool_topo.submitTask(fib, 15);
+        std::cout << "  recursive fib(15) with topology-aware stealing: "
+                  << (root.wait_for(10s) == std::future_status::ready ? root.get() : -1) << " (Expected: 610)" << std::endl;
+    }
+    std::cout << "Test 22 Pool destroyed.\n";
+
+    std::cout << "\n=========== TEST 23: Pool statistics ===========\n";
+    {
+        ThreadPool pool_stats;
+        pool_stats.start(2);
+        std::this_thread::sleep_for(50ms); // 空闲时间在等待结束时计入
+
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 100; ++i) {
+            futures.push_back(pool_stats.submitTask([] {}));
+        }
+        for (auto& f : futures) {
+            f.get();
+        }
+        std::this_thread::sleep_for(50ms);
+        PoolStats stats = pool_stats.getStats();
+        std::cout << "  submitted: " << stats.submitted << " (Expected: 100)"
+                  << ", completed: " << stats.completed << " (Expected: 100)" << std::endl;
+        std::cout << "  threads spawned: " << stats.threadsSpawned << " (Expected: 2)"
+                  << ", current: " << stats.currentThreads << " (Expected: 2)"
+                  << ", idle: " << stats.idleThreads << " (Expected: 2)" << std::endl;
+        std::cout << "  idle time recorded: " << (stats.idleTime.count() > 0 ? "yes" : "no") << " (Expected: yes)"
+                  << ", max queue depth >= 1: " << (stats.maxQueueDepth >= 1 ? "yes" : "no") << " (Expected: yes)" << std::endl;
+    }
+    {
+        // 单线程被占住且队列容量为 1: 第三个任务被拒绝
+        ThreadPool pool_reject;
+        pool_reject.setTaskQueMaxThreshHold(1);
+        pool_reject.setPolicy(RejectionPolicy::CallerRuns);
+        pool_reject.start(1);
+
+        std::atomic<bool> release{false};
+        auto busy = pool_reject.submitTask([&] {
+            while (!release) {
+                std::this_thread::sleep_for(1ms);
+            }
+        });
+        std::this_thread::sleep_for(50ms);
+        auto queued = pool_reject.submitTask([] {});
+        auto inCaller = pool_reject.submitTask([] {});
+        inCaller.get();
+        release = true;
+        busy.get();
+        queued.get();
+        PoolStats stats = pool_reject.getStats();
+        std::cout << "  rejected: " << stats.rejected << " (Expected: 1)"
+                  << ", caller runs: " << stats.callerRuns << " (Expected: 1)"
+                  << ", discarded: " << stats.discarded << " (Expected: 0)"
+                  << ", submitted: " << stats.submitted << " (Expected: 2)" << std::endl;
+    }
+    for (bool always : {false, true})
+    {
+        // 唯一的工作线程忙碌时没有等待者: 按等待者计数时提交不发出通知, 总是通知时每次提交都通知
+        ThreadPool pool_notify;
+        ThreadPoolBenchAccess::setAlwaysNotify(pool_notify, always);
+        pool_notify.start(1);
+        std::atomic<bool> release{false};
+        auto busy = pool_notify.submitTask([&] {
+            while (!release) {
+                std::this_thread::sleep_for(1ms);
+            }
+        });
+        std::this_thread::sleep_for(50ms);
+        uint64_t before = pool_notify.getStats().notifies;
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 10; ++i) {
+            futures.push_back(pool_notify.submitTask([] {}));
+        }
+        uint64_t issued = pool_notify.getStats().notifies - before;
+        release = true;
+        for (auto& f : futures) {
+            f.get();
+        }
+        std::cout << "  notifies while worker busy (" << (always ? "always" : "counted") << "): " << issued
+                  << " (Expected: " << (always ? 10 : 0) << ")" << std::endl;
+    }
+    {
+        // 延迟启动的 cached 线程池: 各槽位的统计分片随线程按需分配, 计数不丢失
+        ThreadPool pool_lazy_stats;
+        pool_lazy_stats.setMode(PoolMode::MODE_CACHED);
+        pool_lazy_stats.setThreadSizeThreshHold(256);
+        pool_lazy_stats.setLazyStart(true);
+        pool_lazy_stats.start(0);
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 4; ++i) {
+            futures.push_back(pool_lazy_stats.submitTask([] { std::this_thread::sleep_for(50ms); }));
+        }
+        for (auto& f : futures) {
+            f.get();
+        }
+        std::this_thread::sleep_for(50ms);
+        PoolStats stats = pool_lazy_stats.getStats();
+        std::cout << "  lazy cached pool: spawned == current: "
+                  << (stats.threadsSpawned == (uint64_t)stats.currentThreads && stats.currentThreads > 0 ? "yes" : "no")
+                  << " (Expected: yes), submitted: " << stats.submitted << " (Expected: 4)"
+                  << ", completed: " << stats.completed << " (Expected: 4)" << std::endl;
+    }
+    std::cout << "Test 23 Pool destroyed.\n";
+
+    std::cout << "\n=========== TEST 24: OpenMetrics export ===========\n";
+    {
+        ThreadPool pool_metrics;
+        pool_metrics.start(2);
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 50; ++i) {
+            futures.push_back(pool_metrics.submitTask([] { std::this_thread::sleep_for(200us); }));
+        }
+        for (auto& f : futures) {
+            f.get();
+        }
+        std::this_thread::sleep_for(20ms);
+
+        std::string text = pool_metrics.renderMetrics("api\"1");
+        auto has = [&](const std::string& line) { return text.find(line) != std::string::npos; };
+        std::cout << "  threads gauge: " << (has("threadpool_threads{pool=\"api\\\"1\"} 2\n") ? "yes" : "no") << " (Expected: yes)" << std::endl;
+        std::cout << "  submitted counter: " << (has("threadpool_tasks_submitted_total{pool=\"api\\\"1\"} 50\n") ? "yes" : "no") << " (Expected: yes)" << std::endl;
+        std::cout << "  rejection counter: " << (has("# TYPE threadpool_tasks_rejected counter\n") ? "yes" : "no") << " (Expected: yes)" << std::endl;
+        std::cout << "  run time histogram +Inf bucket: "
+                  << (has("threadpool_task_run_seconds_bucket{pool=\"api\\\"1\",le=\"+Inf\"} 50\n") ? "yes" : "no") << " (Expected: yes)" << std::endl;
+        bool endsWithEof = text.size() >= 6 && text.compare(text.size() - 6, 6, "# EOF\n") == 0;
+        std::cout << "  ends with # EOF: " << (endsWithEof ? "yes" : "no") << " (Expected: yes)" << std::endl;
+
+#if defined(__linux__)
+        int port = pool_metrics.startMetricsServer(0, "web");
+        auto httpGet = [&](const std::string& path) {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons((uint16_t)port);
+            std::string response;
+            if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+                std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+                ssize_t sent = write(fd, request.data(), request.size());
+                (void)sent;
+                char buf[4096];
+                ssize_t n;
+                while ((n = read(fd, buf, sizeof(buf))) > 0) {
+                    response.append(buf, (size_t)n);
+                }
+            }
+            close(fd);
+            return response;
+        };
+        std::string scraped = httpGet("/metrics");
+        std::cout << "  GET /metrics: " << scraped.substr(0, scraped.find("\r\n")) << " (Expected: HTTP/1.1 200 OK)" << std::endl;
+        std::cout << "  scraped body has pool label: " << (scraped.find("threadpool_threads{pool=\"web\"}") != std::string::npos ? "yes" : "no")
+                  << " (Expected: yes)" << std::endl;
+        std::string missing = httpGet("/other");
+        std::cout << "  GET /other: " << missing.substr(0, missing.find("\r\n")) << " (Expected: HTTP/1.1 404 Not Found)" << std::endl;
+        pool_metrics.stopMetricsServer();
+#endif
+    }
+    std::cout << "Test 24 Pool destroyed.\n";
+
     std::cout << "\n=========== ALL TESTS PASSED ===========\n";
     return 0;
 }
\ No newline at end of file
@@ -2,197 +2,2792 @@
 #include <functional>
 #include <thread>
 #include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if __has_include(<linux/io_uring.h>)
+#define THREADPOOL_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
 
 const int TASK_MAX_THRESHHOLD = INT32_MAX;
 const int THREAD_MAX_THRESHHOLD = 1024;
 const int THREAD_MAX_IDLE_TIME = 60; // 单位：秒
+const int BLOCKING_THREAD_MAX_THRESHHOLD = 512; // submitBlocking() 的 I/O 线程数上限
+const unsigned IO_RING_ENTRIES = 256;            // io_uring 提交队列长度
+const int REACTOR_MAX_EVENTS = 16;               // leader 每次从 epoll 取出的事件数
+const uint32_t EMPTY_SLOT = UINT32_MAX; // 空闲槽位链表为空
+const int STRAND_MAX_BATCH = 64;        // drainStrand 每次最多连续执行的任务数
+
+// 自旋等待时提示 CPU 降低功耗并让出流水线给超线程
+static inline void cpuRelax()
+{
+#if defined(_MSC_VER)
+    _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// ---- 任务节点内存资源 ----
+
+// 任务节点与 future 共享状态大小固定且很小, 按 16 字节分级后用空闲链表复用:
+// 本线程池的工作线程各有一组无锁的本地链表, 其他线程按线程散列到带锁的外部链表;
+// 本地链表过长时把一批节点交给中心链表, 为空时从中心链表取回一批, 中心链表也为空时从上游分配新的一批
+// 释放到上游的内存只在资源析构时归还
+class ThreadPool::TaskNodeResource : public std::pmr::memory_resource
+{
+public:
+    static constexpr size_t GRANULE = 16;                       // 分级粒度, 也是节点的对齐
+    static constexpr size_t MAX_NODE_SIZE = 512;                // 更大的请求直接交给上游
+    static constexpr int CLASSES = (int)(MAX_NODE_SIZE / GRANULE);
+    static constexpr int BATCH = 32;                            // 与中心链表之间每次转移的节点数
+
+    TaskNodeResource(const ThreadPool *owner, std::pmr::memory_resource *upstream)
+        : owner_(owner), upstream_(upstream), chunks_(upstream) {}
+
+    ~TaskNodeResource() override
+    {
+        for (const Chunk &chunk : chunks_)
+        {
+            upstream_->deallocate(chunk.memory, chunk.size, GRANULE);
+        }
+    }
+
+    // 为 owner 的 count 个工作线程槽位分配本地链表, 须在工作线程启动前调用
+    void reserveWorkerCaches(int count)
+    {
+        if (workerCaches_ || count <= 0)
+        {
+            return;
+        }
+        workerCaches_ = makeResourceArray<NodeCache>(upstream_, count);
+        workerCacheCount_ = count;
+    }
+
+private:
+    struct FreeNode
+    {
+        FreeNode *next;
+        FreeNode *nextBatch; // 仅在中心链表中使用: 下一批节点
+    };
+    struct FreeList
+    {
+        FreeNode *head = nullptr;
+        int count = 0;
+    };
+    struct alignas(CACHE_LINE_SIZE) NodeCache
+    {
+        std::mutex mtx; // 仅外部链表使用
+        std::array<FreeList, CLASSES> lists;
+    };
+    struct Chunk
+    {
+        void *memory;
+        size_t size;
+    };
+
+    static int sizeClass(size_t bytes)
+    {
+        return (int)((std::max<size_t>(bytes, 1) + GRANULE - 1) / GRANULE) - 1;
+    }
+
+    // 本线程池工作线程的本地链表, 其他线程返回 nullptr
+    NodeCache *workerCache() const
+    {
+        if (currentPool_ != owner_ || workerIndex_ < 0 || workerIndex_ >= workerCacheCount_)
+        {
+            return nullptr;
+        }
+        return &workerCaches_[workerIndex_];
+    }
+
+    NodeCache &externalCache()
+    {
+        static thread_local size_t shard = std::hash<std::thread::id>{}(std::this_thread::get_id()) % COUNTER_SHARDS;
+        return externalCaches_[shard];
+    }
+
+    void *do_allocate(size_t bytes, size_t alignment) override
+    {
+        if (bytes > MAX_NODE_SIZE || alignment > GRANULE)
+        {
+            return upstream_->allocate(bytes, alignment);
+        }
+        int cls = sizeClass(bytes);
+        if (NodeCache *cache = workerCache())
+        {
+            return pop(cache->lists[cls], cls);
+        }
+        NodeCache &cache = externalCache();
+        std::lock_guard<std::mutex> guard(cache.mtx);
+        return pop(cache.lists[cls], cls);
+    }
+
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override
+    {
+        if (bytes > MAX_NODE_SIZE || alignment > GRANULE)
+        {
+            upstream_->deallocate(p, bytes, alignment);
+            return;
+        }
+        int cls = sizeClass(bytes);
+        if (NodeCache *cache = workerCache())
+        {
+            push(cache->lists[cls], cls, static_cast<FreeNode *>(p));
+            return;
+        }
+        NodeCache &cache = externalCache();
+        std::lock_guard<std::mutex> guard(cache.mtx);
+        push(cache.lists[cls], cls, static_cast<FreeNode *>(p));
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    void *pop(FreeList &list, int cls)
+    {
+        if (list.head == nullptr)
+        {
+            refill(list, cls);
+        }
+        FreeNode *node = list.head;
+        list.head = node->next;
+        list.count--;
+        return node;
+    }
+
+    void push(FreeList &list, int cls, FreeNode *node)
+    {
+        node->next = list.head;
+        list.head = node;
+        if (++list.count < 2 * BATCH)
+        {
+            return;
+        }
+        // 前 BATCH 个节点作为一批交给中心链表
+        FreeNode *last = list.head;
+        for (int i = 1; i < BATCH; i++)
+        {
+            last = last->next;
+        }
+        FreeNode *batch = list.head;
+        list.head = last->next;
+        list.count -= BATCH;
+        last->next = nullptr;
+
+        std::lock_guard<std::mutex> guard(centralMtx_);
+        batch->nextBatch = central_[cls];
+        central_[cls] = batch;
+    }
+
+    void refill(FreeList &list, int cls)
+    {
+        std::lock_guard<std::mutex> guard(centralMtx_);
+        if (FreeNode *batch = central_[cls])
+        {
+            central_[cls] = batch->nextBatch;
+            list.head = batch;
+            list.count = BATCH;
+            return;
+        }
+        size_t nodeSize = (size_t)(cls + 1) * GRANULE;
+        size_t size = nodeSize * BATCH;
+        char *memory = static_cast<char *>(upstream_->allocate(size, GRANULE));
+        try
+        {
+            chunks_.push_back(Chunk{memory, size});
+        }
+        catch (...)
+        {
+            upstream_->deallocate(memory, size, GRANULE);
+            throw;
+        }
+        for (int i = 0; i < BATCH; i++)
+        {
+            FreeNode *node = reinterpret_cast<FreeNode *>(memory + nodeSize * i);
+            node->next = i + 1 < BATCH ? reinterpret_cast<FreeNode *>(memory + nodeSize * (i + 1)) : nullptr;
+        }
+        list.head = reinterpret_cast<FreeNode *>(memory);
+        list.count = BATCH;
+    }
+
+    const ThreadPool *owner_;
+    std::pmr::memory_resource *upstream_;
+    ResourceArray<NodeCache> workerCaches_;
+    int workerCacheCount_ = 0;
+    std::array<NodeCache, COUNTER_SHARDS> externalCaches_;
+    std::mutex centralMtx_;
+    std::array<FreeNode *, CLASSES> central_{};
+    std::pmr::vector<Chunk> chunks_;
+};
+
+#if defined(__linux__)
+// ---- 异步文件 I/O ----
+
+struct ThreadPool::IoRequest
+{
+    bool write;
+    iovec iov;
+    std::function<void(long)> callback; // 为空时结果写入 promise
+    std::promise<long> promise;
+    IoRequest *prevPending = nullptr; // io_uring 进行中请求的双向链表, 受 IoRing::sqMtx_ 保护
+    IoRequest *nextPending = nullptr;
+};
+
+#if defined(THREADPOOL_HAS_IO_URING)
+// 直接通过系统调用使用 io_uring, 不依赖 liburing
+// 所有工作线程共享一个实例: 提交在 sqMtx_ 保护下进行, 由一个收割线程阻塞等待完成事件
+class ThreadPool::IoRing
+{
+public:
+    static std::unique_ptr<IoRing> create(ThreadPool *pool, unsigned entries)
+    {
+        io_uring_params params{};
+        int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+        std::unique_ptr<IoRing> ring(new IoRing(pool, fd));
+        if (!ring->map(params))
+        {
+            return nullptr;
+        }
+        ring->reaper_ = std::thread([r = ring.get()]
+                                    { r->reap(); });
+        return ring;
+    }
+
+    ~IoRing()
+    {
+        stop();
+        if (sqes_ != nullptr)
+        {
+            munmap(sqes_, sqesSize_);
+        }
+        if (cqRing_ != nullptr && cqRing_ != sqRing_)
+        {
+            munmap(cqRing_, cqRingSize_);
+        }
+        if (sqRing_ != nullptr)
+        {
+            munmap(sqRing_, sqRingSize_);
+        }
+        close(ringFd_);
+    }
+
+    // 提交一次读写, 返回 false 表示需要调用者退化为同步读写
+    bool submit(IoRequest *request, int fd, int64_t offset)
+    {
+        std::lock_guard<std::mutex> guard(sqMtx_);
+        // 进行中的请求不超过完成队列长度, 完成事件不会溢出
+        if (stopping_ || inflight_.load(std::memory_order_relaxed) >= cqEntries_)
+        {
+            return false;
+        }
+        if (!push(request->write ? IORING_OP_WRITEV : IORING_OP_READV, fd, (uint64_t)(uintptr_t)&request->iov, 1,
+                  offset, (uint64_t)(uintptr_t)request))
+        {
+            return false;
+        }
+        inflight_.fetch_add(1, std::memory_order_relaxed);
+        request->nextPending = pending_;
+        if (pending_ != nullptr)
+        {
+            pending_->prevPending = request;
+        }
+        pending_ = request;
+        return true;
+    }
+
+    // 取消进行中的请求 (future 得到 -ECANCELED) 并等待其完成事件, 之后停止收割线程
+    // 之后的请求都会退化为同步读写
+    void stop()
+    {
+        if (!reaper_.joinable())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(sqMtx_);
+            stopping_ = true;
+        }
+        // 永远不会就绪的读 (如空管道) 只能靠取消结束; 已在执行中无法取消的请求会自行完成,
+        // 取消请求可能先于目标被内核看到, 因此定期重发
+        while (inflight_.load(std::memory_order_acquire) > 0)
+        {
+            {
+                std::lock_guard<std::mutex> guard(sqMtx_);
+                for (IoRequest *request = pending_; request != nullptr; request = request->nextPending)
+                {
+                    if (!push(IORING_OP_ASYNC_CANCEL, -1, (uint64_t)(uintptr_t)request, 0, 0, CANCEL_USER_DATA))
+                    {
+                        break; // 提交队列已满, 下一轮重试
+                    }
+                }
+            }
+            auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+            while (inflight_.load(std::memory_order_acquire) > 0 && std::chrono::steady_clock::now() < until)
+            {
+                std::this_thread::yield();
+            }
+        }
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> guard(sqMtx_);
+                // user_data 为 0 的 NOP 通知收割线程退出; 收割线程已因错误退出时无需通知
+                if (failed_ || push(IORING_OP_NOP, -1, 0, 0, 0, 0))
+                {
+                    break;
+                }
+            }
+            std::this_thread::yield();
+        }
+        reaper_.join();
+    }
+
+private:
+    IoRing(ThreadPool *pool, int fd) : pool_(pool), ringFd_(fd) {}
+
+    bool map(const io_uring_params &params)
+    {
+        sqEntries_ = params.sq_entries;
+        cqEntries_ = params.cq_entries;
+        sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap)
+        {
+            sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+        }
+
+        void *sq = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+        if (sq == MAP_FAILED)
+        {
+            return false;
+        }
+        sqRing_ = static_cast<char *>(sq);
+        if (singleMmap)
+        {
+            cqRing_ = sqRing_;
+        }
+        else
+        {
+            void *cq = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+            if (cq == MAP_FAILED)
+            {
+                return false;
+            }
+            cqRing_ = static_cast<char *>(cq);
+        }
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+        {
+            return false;
+        }
+        sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+        sqHead_ = reinterpret_cast<unsigned *>(sqRing_ + params.sq_off.head);
+        sqTail_ = reinterpret_cast<unsigned *>(sqRing_ + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned *>(sqRing_ + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned *>(sqRing_ + params.sq_off.array);
+        cqHead_ = reinterpret_cast<unsigned *>(cqRing_ + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned *>(cqRing_ + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned *>(cqRing_ + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(cqRing_ + params.cq_off.cqes);
+        return true;
+    }
+
+    // 填写一个 SQE 并立即提交给内核, 调用者须持有 sqMtx_
+    // addr/len 对读写为 iovec 数组及其长度, 对 IORING_OP_ASYNC_CANCEL 为目标请求的 user_data
+    bool push(uint8_t opcode, int fd, uint64_t addr, unsigned len, int64_t offset, uint64_t userData)
+    {
+        unsigned tail = *sqTail_;
+        if (tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_)
+        {
+            return false;
+        }
+        unsigned index = tail & sqMask_;
+        io_uring_sqe &sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.fd = fd;
+        sqe.addr = addr;
+        sqe.len = len;
+        sqe.off = (uint64_t)offset;
+        sqe.user_data = userData;
+        sqArray_[index] = index;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+
+        long ret;
+        do
+        {
+            ret = syscall(__NR_io_uring_enter, ringFd_, 1, 0, 0, nullptr, 0);
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 1)
+        {
+            // 内核未取走该 SQE (没有 SQPOLL 时只在 io_uring_enter 中读取提交队列), 撤回
+            __atomic_store_n(sqTail_, tail, __ATOMIC_RELEASE);
+            return false;
+        }
+        return true;
+    }
+
+    // 收割线程: 阻塞等待完成事件, 将结果交给线程池分发
+    void reap()
+    {
+        while (true)
+        {
+            long ret = syscall(__NR_io_uring_enter, ringFd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            int error = ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY ? errno : 0;
+            unsigned head = *cqHead_;
+            unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+            bool stopped = false;
+            for (; head != tail; head++)
+            {
+                io_uring_cqe cqe = cqes_[head & cqMask_];
+                __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+                if (cqe.user_data == 0)
+                {
+                    stopped = true;
+                    continue;
+                }
+                if (cqe.user_data == CANCEL_USER_DATA)
+                {
+                    continue; // 取消请求本身的结果无需处理, 被取消的请求另有完成事件
+                }
+                IoRequest *request = reinterpret_cast<IoRequest *>((uintptr_t)cqe.user_data);
+                {
+                    std::lock_guard<std::mutex> guard(sqMtx_);
+                    unlinkPending(request);
+                }
+                pool_->completeIo(request, cqe.res);
+                inflight_.fetch_sub(1, std::memory_order_release);
+            }
+            if (error != 0)
+            {
+                // 无法再等待完成事件: 已收到的事件处理完后, 其余请求以该错误完成, 之后的请求退化为同步读写
+                failPending(-error);
+                return;
+            }
+            if (stopped)
+            {
+                return;
+            }
+        }
+    }
+
+    // 收割线程退出前调用: 标记 ring 失效并以 result 完成所有进行中的请求
+    void failPending(long result)
+    {
+        IoRequest *request;
+        {
+            std::lock_guard<std::mutex> guard(sqMtx_);
+            stopping_ = true;
+            failed_ = true;
+            request = pending_;
+            pending_ = nullptr;
+        }
+        while (request != nullptr)
+        {
+            IoRequest *next = request->nextPending;
+            pool_->completeIo(request, result);
+            inflight_.fetch_sub(1, std::memory_order_release);
+            request = next;
+        }
+    }
+
+    void unlinkPending(IoRequest *request)
+    {
+        if (request->prevPending != nullptr)
+        {
+            request->prevPending->nextPending = request->nextPending;
+        }
+        else
+        {
+            pending_ = request->nextPending;
+        }
+        if (request->nextPending != nullptr)
+        {
+            request->nextPending->prevPending = request->prevPending;
+        }
+    }
+
+    // 请求指针至少按 8 字节对齐, 1 不会与之冲突; 0 留给停止收割线程的 NOP
+    static constexpr uint64_t CANCEL_USER_DATA = 1;
+
+    ThreadPool *pool_;
+    int ringFd_;
+    std::thread reaper_;
+    std::mutex sqMtx_;
+    bool stopping_ = false;
+    bool failed_ = false; // 收割线程因 io_uring_enter 出错而退出, 受 sqMtx_ 保护
+    std::atomic<unsigned> inflight_{0};
+    IoRequest *pending_ = nullptr; // 进行中的请求, 受 sqMtx_ 保护
+
+    char *sqRing_ = nullptr;
+    char *cqRing_ = nullptr;
+    size_t sqRingSize_ = 0;
+    size_t cqRingSize_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    size_t sqesSize_ = 0;
+    unsigned sqEntries_ = 0;
+    unsigned cqEntries_ = 0;
+    unsigned *sqHead_ = nullptr;
+    unsigned *sqTail_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned *sqArray_ = nullptr;
+    unsigned *cqHead_ = nullptr;
+    unsigned *cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe *cqes_ = nullptr;
+};
+#else
+// 没有 io_uring 头文件时所有请求都退化为同步读写
+class ThreadPool::IoRing
+{
+public:
+    static std::unique_ptr<IoRing> create(ThreadPool *, unsigned) { return nullptr; }
+    bool submit(IoRequest *, int, int64_t) { return false; }
+    void stop() {}
+};
+#endif
+#endif
+
+#if defined(__linux__)
+// ---- 事件循环 ----
+
+// fd 一律以 EPOLLONESHOT 注册: 事件处理完后才重新启用, 保证同一 fd 的 handler 不会并发执行
+class ThreadPool::Reactor
+{
+public:
+    struct Registration
+    {
+        int fd;
+        uint32_t events;
+        std::function<void(uint32_t)> handler;
+    };
+
+    Reactor()
+        : epollFd_(epoll_create1(EPOLL_CLOEXEC)),
+          eventFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {
+        if (epollFd_ < 0 || eventFd_ < 0)
+        {
+            closeFds();
+            throw std::runtime_error("Failed to create epoll reactor");
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = eventFd_;
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, eventFd_, &ev);
+    }
+
+    ~Reactor() { closeFds(); }
+
+    void add(int fd, uint32_t events, std::function<void(uint32_t)> handler)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        auto reg = std::make_shared<Registration>(Registration{fd, events, std::move(handler)});
+        epoll_event ev{};
+        ev.events = events | EPOLLONESHOT;
+        ev.data.fd = fd;
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+            throw std::runtime_error("epoll_ctl(EPOLL_CTL_ADD) failed: " + std::string(std::strerror(errno)));
+        }
+        registrations_[fd] = std::move(reg);
+    }
+
+    void modify(int fd, uint32_t events)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        auto it = registrations_.find(fd);
+        if (it == registrations_.end())
+        {
+            throw std::invalid_argument("fd is not registered");
+        }
+        it->second->events = events;
+        rearm(*it->second);
+    }
+
+    void remove(int fd)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        if (registrations_.erase(fd) > 0)
+        {
+            epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+        }
+    }
+
+    void wake()
+    {
+        uint64_t one = 1;
+        ssize_t ret = write(eventFd_, &one, sizeof(one));
+        (void)ret; // 计数器已满时 leader 必然会被唤醒, 忽略 EAGAIN
+    }
+
+    // 阻塞等待事件; 返回的事件中 eventfd 的唤醒已被过滤
+    int wait(epoll_event *events, int maxEvents)
+    {
+        int n = epoll_wait(epollFd_, events, maxEvents, -1);
+        int count = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.fd == eventFd_)
+            {
+                uint64_t value;
+                ssize_t ret = read(eventFd_, &value, sizeof(value));
+                (void)ret;
+                continue;
+            }
+            events[count++] = events[i];
+        }
+        return count;
+    }
+
+    // 调用 fd 的 handler, 之后重新启用该 fd (期间被移除或重新注册则不再启用)
+    void dispatch(int fd, uint32_t events)
+    {
+        std::shared_ptr<Registration> reg;
+        {
+            std::lock_guard<std::mutex> guard(mtx_);
+            auto it = registrations_.find(fd);
+            if (it == registrations_.end())
+            {
+                return;
+            }
+            reg = it->second;
+        }
+        try
+        {
+            reg->handler(events);
+        }
+        catch (const std::exception &e)
+        {
+            // 在工作线程上直接执行, 没有 future 可以传递异常
+            std::cerr << "fd handler threw: " << e.what() << std::endl;
+        }
+        catch (...)
+        {
+            std::cerr << "fd handler threw a non-standard exception" << std::endl;
+        }
+
+        std::lock_guard<std::mutex> guard(mtx_);
+        auto it = registrations_.find(fd);
+        if (it != registrations_.end() && it->second == reg)
+        {
+            rearm(*reg);
+        }
+    }
+
+private:
+    void rearm(const Registration &reg)
+    {
+        epoll_event ev{};
+        ev.events = reg.events | EPOLLONESHOT;
+        ev.data.fd = reg.fd;
+        epoll_ctl(epollFd_, EPOLL_CTL_MOD, reg.fd, &ev);
+    }
+
+    void closeFds()
+    {
+        if (epollFd_ >= 0)
+        {
+            close(epollFd_);
+        }
+        if (eventFd_ >= 0)
+        {
+            close(eventFd_);
+        }
+    }
+
+    int epollFd_;
+    int eventFd_;
+    std::mutex mtx_;
+    std::unordered_map<int, std::shared_ptr<Registration>> registrations_;
+};
+#endif
+
+#if defined(__linux__)
+// ---- 指标 HTTP 服务 ----
+
+// 单线程逐个处理连接: 抓取频率很低, 每次只需渲染一段文本
+class ThreadPool::MetricsServer
+{
+public:
+    MetricsServer(const ThreadPool *pool, int port, std::string poolName)
+        : pool_(pool), poolName_(std::move(poolName)),
+          listenFd_(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)),
+          wakeFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {
+        if (listenFd_ < 0 || wakeFd_ < 0)
+        {
+            closeFds();
+            throw std::runtime_error("Failed to create metrics server socket");
+        }
+        int one = 1;
+        setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        // 只监听本机回环地址
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons((uint16_t)port);
+        if (bind(listenFd_, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd_, 16) < 0)
+        {
+            std::string error = std::strerror(errno);
+            closeFds();
+            throw std::runtime_error("Failed to start metrics server: " + error);
+        }
+        socklen_t len = sizeof(addr);
+        getsockname(listenFd_, (sockaddr *)&addr, &len);
+        port_ = ntohs(addr.sin_port);
+
+        thread_ = std::thread([this]
+                              { serve(); });
+    }
+
+    ~MetricsServer()
+    {
+        uint64_t one = 1;
+        ssize_t ret = write(wakeFd_, &one, sizeof(one));
+        (void)ret;
+        thread_.join();
+        closeFds();
+    }
+
+    int port() const { return port_; }
+
+private:
+    void serve()
+    {
+        while (true)
+        {
+            pollfd fds[2] = {{listenFd_, POLLIN, 0}, {wakeFd_, POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return;
+            }
+            if (fds[1].revents != 0)
+            {
+                return; // 停止
+            }
+            if (fds[0].revents & POLLIN)
+            {
+                int client = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client >= 0)
+                {
+                    handle(client);
+                    close(client);
+                }
+            }
+        }
+    }
+
+    void handle(int client)
+    {
+        // 读取请求头, 最多 4KB; 客户端 1 秒内没有发送数据则放弃
+        std::string request;
+        char buf[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < 4096)
+        {
+            pollfd pfd{client, POLLIN, 0};
+            if (poll(&pfd, 1, 1000) <= 0)
+            {
+                return;
+            }
+            ssize_t n = read(client, buf, sizeof(buf));
+            if (n <= 0)
+            {
+                return;
+            }
+            request.append(buf, (size_t)n);
+        }
+
+        // 请求行: GET /metrics[?query] HTTP/1.x
+        std::string line = request.substr(0, request.find("\r\n"));
+        size_t pathBegin = line.find(' ');
+        size_t pathEnd = pathBegin == std::string::npos ? std::string::npos : line.find_first_of(" ?", pathBegin + 1);
+        std::string method = line.substr(0, pathBegin);
+        std::string path = pathEnd == std::string::npos ? "" : line.substr(pathBegin + 1, pathEnd - pathBegin - 1);
+
+        std::string status = "200 OK";
+        std::string contentType = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+        std::string body;
+        if (method != "GET")
+        {
+            status = "405 Method Not Allowed";
+            contentType = "text/plain";
+            body = "Method Not Allowed\n";
+        }
+        else if (path != "/metrics")
+        {
+            status = "404 Not Found";
+            contentType = "text/plain";
+            body = "Not Found\n";
+        }
+        else
+        {
+            body = pool_->renderMetrics(poolName_);
+        }
+
+        std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: " + contentType +
+                               "\r\nContent-Length: " + std::to_string(body.size()) +
+                               "\r\nConnection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.size())
+        {
+            ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                return;
+            }
+            sent += (size_t)n;
+        }
+    }
+
+    void closeFds()
+    {
+        if (listenFd_ >= 0)
+        {
+            close(listenFd_);
+        }
+        if (wakeFd_ >= 0)
+        {
+            close(wakeFd_);
+        }
+    }
+
+    const ThreadPool *pool_;
+    std::string poolName_;
+    int listenFd_;
+    int wakeFd_;
+    int port_ = 0;
+    std::thread thread_;
+};
+#endif
+
+thread_local ThreadPool *ThreadPool::currentPool_ = nullptr;
+thread_local int ThreadPool::blockingDepth_ = 0;
+thread_local int ThreadPool::workerIndex_ = -1;
 
 ThreadPool::ThreadPool()
-    : initThreadSize_(0),
-      idleThreadSize_(0),
-      curThreadSize_(0),
-      taskQueMaxThreshHold_(TASK_MAX_THRESHHOLD),
+    : ThreadPool(std::pmr::get_default_resource()) {}
+
+ThreadPool::ThreadPool(std::pmr::memory_resource *resource)
+    : workerCpu_(resource),
+      workerGroup_(resource),
+      groupSlots_(resource),
+      memoryResource_(resource),
+      initThreadSize_(0),
       threadSizeThreshHold_(THREAD_MAX_THRESHHOLD),
+      taskQueMaxThreshHold_(TASK_MAX_THRESHHOLD),
       poolMode_(PoolMode::MODE_FIXED),
-      isPoolRunning_(false) {}
+      taskResource_(std::allocate_shared<TaskNodeResource>(
+          std::pmr::polymorphic_allocator<TaskNodeResource>(resource), this, resource)),
+      blockingThreadSizeThreshHold_(BLOCKING_THREAD_MAX_THRESHHOLD),
+      flows_(std::pmr::polymorphic_allocator<TaskFlow>(resource)),
+      tenantFlows_(std::pmr::polymorphic_allocator<std::pair<const uint64_t, TaskFlow *>>(resource)),
+      retiredTenants_(std::pmr::polymorphic_allocator<std::pair<const uint64_t, TenantCounters>>(resource)),
+      isPoolRunning_(false),
+      curThreadSize_(0)
+{
+    taskNodeResource_ = static_cast<TaskNodeResource *>(taskResource_.get());
+    // 默认执行器
+    flows_.emplace_back("default", 1, 0, schedulePolicy_, memoryResource_);
+}
+
+ThreadPool::~ThreadPool()
+{
+    shutdown();
+    for (auto &entry : tenantFlows_)
+    {
+        destroyTenantFlow(entry.second);
+    }
+}
+
+void ThreadPool::setMode(PoolMode mode)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    poolMode_ = mode;
+}
+
+void ThreadPool::setPolicy(RejectionPolicy policy)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    rejectionPolicy_ = policy;
+}
+
+void ThreadPool::setTaskQueMaxThreshHold(int threshhold)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    taskQueMaxThreshHold_ = threshhold;
+}
+
+void ThreadPool::setThreadSizeThreshHold(int threshhold)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    if (poolMode_ == PoolMode::MODE_CACHED)
+    {
+        threadSizeThreshHold_ = threshhold;
+    }
+}
+
+void ThreadPool::setTaskQueMaxBytes(size_t bytes)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    taskQueMaxBytes_ = bytes;
+}
+
+void ThreadPool::setSchedulePolicy(SchedulePolicy policy)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    schedulePolicy_ = policy;
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    for (TaskFlow &flow : flows_)
+    {
+        flow.queue = TaskQueue(TaskCompare{policy}, std::pmr::polymorphic_allocator<myTask>(memoryResource_));
+    }
+    for (auto &entry : tenantFlows_)
+    {
+        entry.second->queue = TaskQueue(TaskCompare{policy}, std::pmr::polymorphic_allocator<myTask>(memoryResource_));
+    }
+}
+
+void ThreadPool::setIdleStrategy(int spinCount, int yieldCount)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    spinCount_ = spinCount;
+    yieldCount_ = yieldCount;
+}
+
+void ThreadPool::setLazyStart(bool lazy)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    lazyStart_ = lazy;
+}
+
+void ThreadPool::setTaskBatchSize(int maxBatch)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    taskBatchSize_ = std::max(1, std::min(maxBatch, MAX_TASK_BATCH + 1));
+}
+
+void ThreadPool::setAffinityStealThreshHold(int threshhold)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    affinityStealThreshHold_ = std::max(0, threshhold);
+}
+
+void ThreadPool::setTopologyAware(bool enable)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    topologyAware_ = enable;
+}
+
+void ThreadPool::setAlwaysNotify(bool always)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    alwaysNotify_ = always;
+}
+
+void ThreadPool::setTaskMemoryResource(std::pmr::memory_resource *resource)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    // 不接管所有权
+    taskNodeResource_ = nullptr;
+    taskResource_ = std::shared_ptr<std::pmr::memory_resource>(resource, [](std::pmr::memory_resource *) {});
+}
+
+void ThreadPool::setBlockingThreadSizeThreshHold(int threshhold)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    blockingThreadSizeThreshHold_ = std::max(1, threshhold);
+}
+
+void ThreadPool::setBlockingCompensationThreshHold(int threshhold)
+{
+    if (checkRunningState())
+    {
+        return;
+    }
+    blockingCompensationThreshHold_ = std::max(0, threshhold);
+}
+
+void ThreadPool::start(int initThreadSize)
+{
+    // 设置线程池运行状态
+    isPoolRunning_ = true;
+    // 记录初始线程个数
+    initThreadSize_ = initThreadSize;
+
+    // 一次性分配全部线程槽位, 除启动批次外的槽位放入空闲链表
+    // 仅在设置了补偿上限时额外预留阻塞区域补偿线程的槽位
+    int baseCapacity = poolMode_ == PoolMode::MODE_CACHED ? std::max(threadSizeThreshHold_, initThreadSize_)
+                                                          : initThreadSize_;
+    threadCapacity_ = baseCapacity + blockingCompensationThreshHold_;
+    threads_ = makeResourceArray<Thread>(memoryResource_, threadCapacity_);
+    if (taskNodeResource_ != nullptr)
+    {
+        taskNodeResource_->reserveWorkerCaches(threadCapacity_);
+    }
+    if (taskBatchSize_ > 1)
+    {
+        taskBatches_ = makeResourceArray<TaskBatch>(memoryResource_, threadCapacity_);
+    }
+#if THREADPOOL_STATS
+    statsSlots_ = makeResourceArray<StatsSlot>(memoryResource_, threadCapacity_, memoryResource_);
+    externalStats_ = makeResourceArray<StatsShard>(memoryResource_, COUNTER_SHARDS);
+    for (int i = 0; i < (lazyStart_ ? 0 : initThreadSize_); i++)
+    {
+        allocStatsShard(i);
+    }
+#endif
+    if (topologyAware_)
+    {
+        // 按分组顺序排列 CPU, 相邻槽位尽量共享 L3; 线程数多于 CPU 时循环使用
+        std::vector<std::vector<int>> groups = readCacheTopology(); // 临时结果
+        std::vector<std::pair<int, int>> cpus; // (cpu, 分组)
+        for (size_t g = 0; g < groups.size(); g++)
+        {
+            for (int cpu : groups[g])
+            {
+                cpus.emplace_back(cpu, (int)g);
+            }
+        }
+        workerCpu_.assign(threadCapacity_, -1);
+        workerGroup_.assign(threadCapacity_, 0);
+        groupSlots_.assign(std::max<size_t>(1, groups.size()), {});
+        for (int i = 0; i < threadCapacity_; i++)
+        {
+            if (!cpus.empty())
+            {
+                workerCpu_[i] = cpus[i % cpus.size()].first;
+                workerGroup_[i] = cpus[i % cpus.size()].second;
+            }
+            groupSlots_[workerGroup_[i]].push_back(i);
+        }
+    }
+    if (!lazyStart_ && initThreadSize_ > 0)
+    {
+        affinityQueues_ = makeResourceArray<AffinityQueue>(memoryResource_, initThreadSize_, memoryResource_);
+        affinityQueueCount_ = initThreadSize_;
+    }
+    int firstFree = lazyStart_ ? 0 : initThreadSize_;
+    for (int i = firstFree; i < threadCapacity_; i++)
+    {
+        threads_[i].nextFreeSlot_.store(i + 1 < threadCapacity_ ? i + 1 : -1, std::memory_order_relaxed);
+    }
+    freeSlotHead_.store(firstFree < threadCapacity_ ? (uint32_t)firstFree : EMPTY_SLOT, std::memory_order_release);
+
+    if (lazyStart_)
+    {
+        // 线程在提交任务时按需创建
+        curThreadSize_ = 0;
+        return;
+    }
+    curThreadSize_ = initThreadSize;
+
+    // 调用者只启动第一个线程, 其余线程由已启动的线程并行启动, 启动耗时约为 O(log n) 次线程创建
+    if (initThreadSize_ > 0)
+    {
+        pendingStartSize_ = initThreadSize_;
+        threads_[0].start([this](int threadid)
+                          {
+                              startBatchChildren(threadid);
+                              threadFunc(threadid); },
+                          0);
+        pendingStartSize_.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void ThreadPool::startBatchChildren(int index)
+{
+    for (int child = 2 * index + 1; child <= 2 * index + 2 && child < initThreadSize_; child++)
+    {
+        threads_[child].start([this](int threadid)
+                              {
+                                  startBatchChildren(threadid);
+                                  threadFunc(threadid); },
+                              child);
+        pendingStartSize_.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void ThreadPool::spawnThread()
+{
+    // curThreadSize_ 不超过容量, 空闲槽位总能取到; 退出中的线程可能稍后才归还槽位
+    int index = acquireSlot();
+    while (index < 0)
+    {
+        std::this_thread::yield();
+        index = acquireSlot();
+    }
+#if THREADPOOL_STATS
+    allocStatsShard(index);
+#endif
+    // 槽位上可能还有刚退出、尚未 join 的线程
+    threads_[index].join();
+    threads_[index].start([this](int threadid)
+                          { threadFunc(threadid); },
+                          index);
+    pendingStartSize_.fetch_sub(1, std::memory_order_release);
+}
+
+#if THREADPOOL_STATS
+void ThreadPool::allocStatsShard(int index)
+{
+    StatsSlot &slot = statsSlots_[index];
+    if (slot.shard.load(std::memory_order_acquire) != nullptr)
+    {
+        return; // 槽位之前启动过线程, 沿用其分片
+    }
+    StatsShard *shard;
+    try
+    {
+        shard = new (memoryResource_->allocate(sizeof(StatsShard), alignof(StatsShard))) StatsShard();
+    }
+    catch (...)
+    {
+        return; // 分配失败不影响线程启动, 该槽位的线程改用外部分片计数
+    }
+    StatsShard *expected = nullptr;
+    if (!slot.shard.compare_exchange_strong(expected, shard, std::memory_order_acq_rel))
+    {
+        shard->~StatsShard();
+        memoryResource_->deallocate(shard, sizeof(StatsShard), alignof(StatsShard));
+    }
+}
+#endif
+
+int ThreadPool::acquireSlot()
+{
+    uint64_t head = freeSlotHead_.load(std::memory_order_acquire);
+    while (true)
+    {
+        uint32_t index = (uint32_t)head;
+        if (index == EMPTY_SLOT)
+        {
+            return -1;
+        }
+        uint32_t next = (uint32_t)threads_[index].nextFreeSlot_.load(std::memory_order_relaxed);
+        // 版本号加一, 防止 ABA
+        uint64_t newHead = (((head >> 32) + 1) << 32) | next;
+        if (freeSlotHead_.compare_exchange_weak(head, newHead,
+                                                std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            return (int)index;
+        }
+    }
+}
+
+void ThreadPool::releaseSlot(int index)
+{
+    uint64_t head = freeSlotHead_.load(std::memory_order_relaxed);
+    while (true)
+    {
+        threads_[index].nextFreeSlot_.store((int)(uint32_t)head, std::memory_order_relaxed);
+        uint64_t newHead = (((head >> 32) + 1) << 32) | (uint32_t)index;
+        if (freeSlotHead_.compare_exchange_weak(head, newHead,
+                                                std::memory_order_release, std::memory_order_relaxed))
+        {
+            return;
+        }
+    }
+}
+
+void ThreadPool::shutdown()
+{
+#if defined(__linux__)
+    // 先等待进行中的异步 I/O 完成, 其回调还需要提交到线程池
+    if (ioRing_)
+    {
+        ioRing_->stop();
+    }
+#endif
+
+    {
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        isPoolRunning_ = false;
+        notifyAll(notEmpty);
+        if (reactorLeaderWaiting_)
+        {
+            wakeReactor();
+        }
+    }
+
+    // 等待已决定创建的线程全部启动, 之后才能安全地 join
+    while (pendingStartSize_.load(std::memory_order_acquire) > 0)
+    {
+        std::this_thread::yield();
+    }
+
+    // 运行状态已置为 false, 之后不会再有线程创建或回收
+    for (int i = 0; i < threadCapacity_; i++)
+    {
+        threads_[i].join();
+    }
+
+    // 计算任务可能还在向 I/O 线程池提交任务, 最后关闭
+    // 空的 call_once 等待可能正在进行的创建完成, 之后不会再创建
+    std::call_once(blockingPoolOnce_, [] {});
+    if (blockingPool_)
+    {
+        blockingPool_->shutdown();
+    }
+
+#if defined(__linux__)
+    // 关闭过程中仍可抓取指标
+    stopMetricsServer();
+#endif
+}
+
+int ThreadPool::threadLimit() const
+{
+    // cached 模式最多增长到 threadSizeThreshHold_; 延迟启动时最多补齐到 initThreadSize_
+    int limit = poolMode_ == PoolMode::MODE_CACHED ? threadSizeThreshHold_ : initThreadSize_;
+    return std::min(limit + std::min(blockingThreadSize_, blockingCompensationThreshHold_), threadCapacity_);
+}
+
+ThreadPool &ThreadPool::blockingLane()
+{
+    if (isBlockingLane_ || !isPoolRunning_)
+    {
+        return *this; // 由 submitTask 拒绝
+    }
+    // 阻塞任务的 I/O 线程池: cached 模式, 线程全部按需创建, 与本线程池共享任务内存资源
+    std::call_once(blockingPoolOnce_, [this]
+                   {
+        auto lane = std::make_unique<ThreadPool>(memoryResource_);
+        lane->isBlockingLane_ = true;
+        lane->taskResource_ = taskResource_;
+        lane->taskNodeResource_ = nullptr;
+        lane->setMode(PoolMode::MODE_CACHED);
+        lane->setThreadSizeThreshHold(blockingThreadSizeThreshHold_);
+        lane->setLazyStart(true);
+        lane->start(0);
+        blockingPool_ = std::move(lane); });
+    return blockingPool_ ? *blockingPool_ : *this;
+}
+
+void ThreadPool::enterBlocking()
+{
+    ThreadPool *pool = currentPool_;
+    if (pool == nullptr || blockingDepth_++ > 0)
+    {
+        return;
+    }
+
+    bool needNewThread = false;
+    {
+        std::unique_lock<std::mutex> lock(pool->taskQueMtx_);
+        pool->blockingThreadSize_++;
+        // 仅在有任务等待执行时补偿, 补偿线程在阻塞结束后空闲时退出
+        if (pool->isPoolRunning_ &&
+            pool->queuedTaskSize_ > (size_t)pool->getIdleThreadCount() &&
+            pool->curThreadSize_ < pool->threadLimit())
+        {
+            pool->curThreadSize_++;
+            pool->pendingStartSize_++;
+            needNewThread = true;
+        }
+    }
+    if (needNewThread)
+    {
+        pool->spawnThread();
+    }
+}
+
+void ThreadPool::exitBlocking()
+{
+    ThreadPool *pool = currentPool_;
+    if (pool == nullptr || blockingDepth_ == 0 || --blockingDepth_ > 0)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(pool->taskQueMtx_);
+    pool->blockingThreadSize_--;
+    // 线程数超出上限时唤醒一个空闲线程让其退出
+    if (pool->curThreadSize_ > pool->threadLimit() && pool->notEmptyWaiters_ > 0)
+    {
+        pool->notifyOne(pool->notEmpty);
+    }
+}
+
+int ThreadPool::getWorkerGroup(int index) const
+{
+    return index >= 0 && index < (int)workerGroup_.size() ? workerGroup_[index] : -1;
+}
+
+int ThreadPool::getWorkerCpu(int index) const
+{
+    return index >= 0 && index < (int)workerCpu_.size() ? workerCpu_[index] : -1;
+}
+
+std::vector<std::vector<int>> ThreadPool::readCacheTopology()
+{
+    int cpuCount = (int)std::max(1u, std::thread::hardware_concurrency());
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool hasMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    if (hasMask)
+    {
+        cpuCount = std::max(cpuCount, (int)CPU_SETSIZE);
+    }
+
+    // 分组键为共享同一 L3 的最小 CPU 编号 (shared_cpu_list 升序, 取第一个数即可);
+    // 没有 L3 信息时用物理封装编号, 加上偏移以免与 CPU 编号冲突
+    std::map<int, std::vector<int>> groups;
+    for (int cpu = 0; cpu < cpuCount; cpu++)
+    {
+        if (hasMask && !CPU_ISSET(cpu, &allowed))
+        {
+            continue;
+        }
+        std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+        int key = -1;
+        for (int index = 0; index < 8 && key < 0; index++)
+        {
+            std::string cache = base + "/cache/index" + std::to_string(index);
+            int level = 0;
+            std::ifstream levelFile(cache + "/level");
+            if (!(levelFile >> level))
+            {
+                break;
+            }
+            if (level == 3)
+            {
+                std::ifstream shared(cache + "/shared_cpu_list");
+                shared >> key;
+            }
+        }
+        if (key < 0)
+        {
+            int package = 0;
+            std::ifstream packageFile(base + "/topology/physical_package_id");
+            if (!(packageFile >> package) && !hasMask)
+            {
+                continue; // CPU 不存在或已离线
+            }
+            key = CPU_SETSIZE + std::max(0, package);
+        }
+        groups[key].push_back(cpu);
+    }
+
+    std::vector<std::vector<int>> result;
+    for (auto &group : groups)
+    {
+        result.push_back(std::move(group.second));
+    }
+    if (!result.empty())
+    {
+        return result;
+    }
+#endif
+    std::vector<int> all(cpuCount);
+    for (int i = 0; i < cpuCount; i++)
+    {
+        all[i] = i;
+    }
+    return {all};
+}
+
+void ThreadPool::countLatency(std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKETS> StatsShard::*buckets,
+                              StatField sum, Clock::duration latency)
+{
+    int64_t nanos = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+    const auto &bounds = LatencyHistogram::BOUNDS_NS;
+    int bucket = (int)(std::lower_bound(bounds.begin(), bounds.end(), nanos) - bounds.begin());
+#if THREADPOOL_STATS
+    StatsShard &shard = statsShard();
+    (shard.*buckets)[bucket].fetch_add(1, std::memory_order_relaxed);
+    (shard.*sum).fetch_add((uint64_t)nanos, std::memory_order_relaxed);
+#else
+    (void)buckets;
+    (void)sum;
+    (void)bucket;
+#endif
+}
+
+PoolStats ThreadPool::getStats() const
+{
+    PoolStats stats;
+#if THREADPOOL_STATS
+    if (externalStats_)
+    {
+        uint64_t idleNanos = 0;
+        uint64_t lockWaitNanos = 0;
+        for (int i = 0; i < threadCapacity_ + COUNTER_SHARDS; i++)
+        {
+            // 跳过从未启动过线程的槽位
+            const StatsShard *shard = i < threadCapacity_ ? statsSlots_[i].shard.load(std::memory_order_acquire)
+                                                          : &externalStats_[i - threadCapacity_];
+            if (shard == nullptr)
+            {
+                continue;
+            }
+            stats.submitted += shard->submitted.load(std::memory_order_relaxed);
+            stats.completed += shard->completed.load(std::memory_order_relaxed);
+            stats.rejected += shard->rejected.load(std::memory_order_relaxed);
+            stats.callerRuns += shard->callerRuns.load(std::memory_order_relaxed);
+            stats.discarded += shard->discarded.load(std::memory_order_relaxed);
+            stats.threadsSpawned += shard->threadsSpawned.load(std::memory_order_relaxed);
+            stats.threadsReaped += shard->threadsReaped.load(std::memory_order_relaxed);
+            stats.notifies += shard->notifies.load(std::memory_order_relaxed);
+            idleNanos += shard->idleNanos.load(std::memory_order_relaxed);
+            lockWaitNanos += shard->lockWaitNanos.load(std::memory_order_relaxed);
+            for (int b = 0; b < LatencyHistogram::BUCKETS; b++)
+            {
+                stats.queueWait.counts[b] += shard->queueWaitBuckets[b].load(std::memory_order_relaxed);
+                stats.runTime.counts[b] += shard->runTimeBuckets[b].load(std::memory_order_relaxed);
+            }
+            stats.queueWait.sum += std::chrono::nanoseconds(shard->queueWaitNanos.load(std::memory_order_relaxed));
+            stats.runTime.sum += std::chrono::nanoseconds(shard->runTimeNanos.load(std::memory_order_relaxed));
+        }
+        stats.idleTime = std::chrono::nanoseconds(idleNanos);
+        stats.lockWaitTime = std::chrono::nanoseconds(lockWaitNanos);
+    }
+    stats.maxQueueDepth = maxQueueDepth_.load(std::memory_order_relaxed);
+#endif
+    stats.currentThreads = getCurrentThreadCount();
+    stats.idleThreads = getIdleThreadCount();
+    stats.queuedTasks = queuedTaskSize_.load(std::memory_order_relaxed) +
+                        batchedTaskSize_.load(std::memory_order_relaxed) +
+                        affinityTaskSize_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// OpenMetrics 标签值转义
+static std::string escapeLabelValue(const std::string &value)
+{
+    std::string escaped;
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (c == '\n')
+        {
+            escaped += "\\n";
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+static std::string formatSeconds(std::chrono::nanoseconds d)
+{
+    std::ostringstream out;
+    out.precision(12);
+    out << (double)d.count() / 1e9;
+    return out.str();
+}
+
+// 输出一个只有单个样本的指标; 计数器的样本名带 _total 后缀
+static void writeMetric(std::ostringstream &out, const std::string &name, const char *type, const char *help,
+                        const std::string &labels, const std::string &value)
+{
+    bool counter = std::string(type) == "counter";
+    out << "# TYPE " << name << ' ' << type << '\n'
+        << "# HELP " << name << ' ' << help << '\n'
+        << name << (counter ? "_total" : "") << '{' << labels << "} " << value << '\n';
+}
+
+// 直方图的桶为累计计数, le 为以秒为单位的上界
+static void writeHistogram(std::ostringstream &out, const std::string &name, const char *help,
+                           const std::string &labels, const LatencyHistogram &histogram)
+{
+    out << "# TYPE " << name << " histogram\n"
+        << "# HELP " << name << ' ' << help << '\n';
+    uint64_t cumulative = 0;
+    for (int b = 0; b < LatencyHistogram::BUCKETS; b++)
+    {
+        cumulative += histogram.counts[b];
+        std::string le = b + 1 < LatencyHistogram::BUCKETS
+                             ? formatSeconds(std::chrono::nanoseconds(LatencyHistogram::BOUNDS_NS[b]))
+                             : "+Inf";
+        out << name << "_bucket{" << labels << ",le=\"" << le << "\"} " << cumulative << '\n';
+    }
+    out << name << "_count{" << labels << "} " << cumulative << '\n'
+        << name << "_sum{" << labels << "} " << formatSeconds(histogram.sum) << '\n';
+}
+
+std::string ThreadPool::renderMetrics(const std::string &poolName) const
+{
+    PoolStats stats = getStats();
+    std::string labels = "pool=\"" + escapeLabelValue(poolName) + "\"";
+    std::ostringstream out;
+
+    writeMetric(out, "threadpool_threads", "gauge", "Current number of worker threads.", labels,
+                std::to_string(stats.currentThreads));
+    writeMetric(out, "threadpool_idle_threads", "gauge", "Worker threads waiting for tasks.", labels,
+                std::to_string(stats.idleThreads));
+    writeMetric(out, "threadpool_active_threads", "gauge", "Worker threads running tasks.", labels,
+                std::to_string(std::max(0, stats.currentThreads - stats.idleThreads)));
+    writeMetric(out, "threadpool_queued_tasks", "gauge", "Tasks waiting in the shared queue, batch buffers and affinity queues.",
+                labels, std::to_string(stats.queuedTasks));
+    writeMetric(out, "threadpool_queue_depth_max", "gauge", "Maximum depth reached by the shared queue.", labels,
+                std::to_string(stats.maxQueueDepth));
+    writeMetric(out, "threadpool_outstanding_task_bytes", "gauge", "Memory footprint of queued and running tasks.", labels,
+                std::to_string(getOutstandingTaskBytes()));
+
+    writeMetric(out, "threadpool_tasks_submitted", "counter", "Tasks accepted into the pool.", labels,
+                std::to_string(stats.submitted));
+    writeMetric(out, "threadpool_tasks_completed", "counter", "Tasks finished by worker threads, including expired ones.", labels,
+                std::to_string(stats.completed));
+    writeMetric(out, "threadpool_tasks_rejected", "counter", "Submissions that hit a full queue and applied the rejection policy.",
+                labels, std::to_string(stats.rejected));
+    writeMetric(out, "threadpool_tasks_caller_runs", "counter", "Rejected tasks run on the submitting thread.", labels,
+                std::to_string(stats.callerRuns));
+    writeMetric(out, "threadpool_tasks_discarded", "counter", "Rejected tasks dropped by the Discard policy.", labels,
+                std::to_string(stats.discarded));
+    writeMetric(out, "threadpool_tasks_expired", "counter", "Tasks dropped because their deadline had passed.", labels,
+                std::to_string(getExpiredTaskCount()));
+    writeMetric(out, "threadpool_threads_spawned", "counter", "Worker threads started.", labels,
+                std::to_string(stats.threadsSpawned));
+    writeMetric(out, "threadpool_threads_reaped", "counter", "Worker threads that exited while the pool was running.", labels,
+                std::to_string(stats.threadsReaped));
+    writeMetric(out, "threadpool_notifies", "counter", "Condition variable notifications issued to waiting workers and producers.",
+                labels, std::to_string(stats.notifies));
+    writeMetric(out, "threadpool_idle_seconds", "counter", "Time worker threads spent waiting for tasks.", labels,
+                formatSeconds(stats.idleTime));
+    writeMetric(out, "threadpool_lock_wait_seconds", "counter", "Time spent waiting for the task queue lock.", labels,
+                formatSeconds(stats.lockWaitTime));
+
+    writeHistogram(out, "threadpool_task_queue_wait_seconds", "Time from enqueue to start of execution.", labels,
+                   stats.queueWait);
+    writeHistogram(out, "threadpool_task_run_seconds", "Task execution time.", labels, stats.runTime);
+    out << "# EOF\n";
+    return out.str();
+}
+
+#if defined(__linux__)
+int ThreadPool::startMetricsServer(int port, const std::string &poolName)
+{
+    stopMetricsServer();
+    metricsServer_ = std::make_unique<MetricsServer>(this, port, poolName);
+    return metricsServer_->port();
+}
+
+void ThreadPool::stopMetricsServer()
+{
+    metricsServer_.reset();
+}
+#endif
+
+int ThreadPool::getCurrentThreadCount() const
+{
+    return curThreadSize_;
+}
+
+int ThreadPool::getIdleThreadCount() const
+{
+    int idle = 0;
+    for (const CounterShard &shard : idleThreadShards_)
+    {
+        idle += shard.value.load(std::memory_order_relaxed);
+    }
+    return idle;
+}
+
+int ThreadPool::getActiveThreadCount() const
+{
+    // 分片是分别读取的, 汇总值可能短暂超过当前线程数
+    return std::max(0, curThreadSize_ - getIdleThreadCount());
+}
+
+size_t ThreadPool::getTaskQueueSize()
+{
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    return queuedTaskSize_ + batchedTaskSize_.load(std::memory_order_relaxed) +
+           affinityTaskSize_.load(std::memory_order_relaxed);
+}
+
+size_t ThreadPool::getExpiredTaskCount() const
+{
+    return expiredTaskCount_;
+}
+
+size_t ThreadPool::getOutstandingTaskBytes() const
+{
+    return outstandingTaskBytes_;
+}
+
+bool ThreadPool::hasByteBudget(size_t footprint) const
+{
+    if (taskQueMaxBytes_ == 0)
+    {
+        return true;
+    }
+    size_t outstanding = outstandingTaskBytes_.load();
+    return outstanding == 0 || outstanding + footprint <= taskQueMaxBytes_;
+}
+
+bool ThreadPool::waitForSpace(std::unique_lock<std::mutex> &lock, size_t footprint)
+{
+    auto admissible = [&]() -> bool
+    {
+        return boundedTaskCount() < (size_t)taskQueMaxThreshHold_ && hasByteBudget(footprint);
+    };
+    if (admissible())
+    {
+        return true;
+    }
+    // 先登记再检查条件: 与 releaseTaskBytes / notifySpaceFreed 先归还再读登记数配对, 不会错过唤醒
+    notFullWaiters_++;
+    spaceWaiters_++;
+    bool hasSpace = notFull.wait_for(lock, std::chrono::seconds(1), admissible);
+    spaceWaiters_--;
+    notFullWaiters_--;
+    return hasSpace;
+}
+
+void ThreadPool::rejectTask(std::unique_lock<std::mutex> &lock, TaskPtr &task, Clock::time_point deadline)
+{
+    countStat(&StatsShard::rejected);
+    switch (rejectionPolicy_)
+    {
+    case RejectionPolicy::Abort:
+        std::cerr << "submit task timeout" << std::endl;
+        throw std::runtime_error("Task queue is full...");
+
+    case RejectionPolicy::Discard:
+        std::cerr << "Task discarded" << std::endl;
+        countStat(&StatsShard::discarded);
+        return;
+
+    case RejectionPolicy::CallerRuns:
+        std::cerr << "Task queue full, running in caller thread" << std::endl;
+        lock.unlock();
+        countStat(&StatsShard::callerRuns);
+
+        if (deadline < Clock::now())
+        {
+            expiredTaskCount_++;
+            task->expire();
+        }
+        else
+        {
+            task->execute();
+        }
+        return;
+    }
+}
+
+void ThreadPool::notifySpaceFreed()
+{
+    // 亲和队列与缓冲区的计数已在锁外以顺序一致的原子操作减少, 与 releaseTaskBytes 相同
+    if (spaceWaiters_.load() > 0)
+    {
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        notifyAll(notFull);
+    }
+}
+
+void ThreadPool::releaseTaskBytes(size_t footprint)
+{
+    if (footprint == 0)
+    {
+        return; // Strand 内的任务及其调度任务不计入字节预算
+    }
+    outstandingTaskBytes_.fetch_sub(footprint);
+    // 只有提交者在等待时才加锁通知; 两处都是顺序一致的原子操作, 提交者要么看到归还的字节, 要么在这里被看到
+    if (taskQueMaxBytes_ > 0 && spaceWaiters_.load() > 0)
+    {
+        // 预算在锁外归还, 需加锁后再通知, 避免提交者检查条件后错过唤醒
+        // 各任务占用不同, 唤醒全部等待者让能放下的那个继续
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        notifyAll(notFull);
+    }
+}
+
+void ThreadPool::pushTask(myTask &&task)
+{
+    TaskFlow *flow = task.flow_;
+    task.enqueued_ = statsNow();
+    flow->queue.push(std::move(task));
+    flow->submittedTasks.fetch_add(1, std::memory_order_relaxed);
+    queuedTaskSize_++;
+    countStat(&StatsShard::submitted);
+#if THREADPOOL_STATS
+    if (queuedTaskSize_ > maxQueueDepth_.load(std::memory_order_relaxed))
+    {
+        maxQueueDepth_.store(queuedTaskSize_, std::memory_order_relaxed);
+    }
+#endif
+    if (!flow->active && flow->runnable())
+    {
+        activateFlow(flow);
+    }
+}
+
+void ThreadPool::enqueueTask(std::unique_lock<std::mutex> &lock, myTask &&task)
+{
+    size_t footprint = task.footprint_;
+    pushTask(std::move(task));
+    outstandingTaskBytes_ += footprint;
+    // 只有确实有线程阻塞等待, 且自旋中的线程不足以接手所有排队任务时才唤醒
+    if (alwaysNotify_ || (notEmptyWaiters_ > 0 && (size_t)spinningThreadSize_ < queuedTaskSize_))
+    {
+        notifyOne(notEmpty);
+    }
+    else if (reactorLeaderWaiting_)
+    {
+        // 唯一空闲的线程正阻塞在 epoll 上
+        wakeReactor();
+    }
 
-ThreadPool::~ThreadPool()
+    bool needNewThread = reserveThread(queuedTaskSize_);
+
+    lock.unlock();
+
+    if (needNewThread)
+    {
+        spawnThread();
+    }
+}
+
+bool ThreadPool::tryEnqueueTask(TaskPtr task, size_t footprint)
 {
-    shutdown();
+    std::unique_lock<std::mutex> lock(taskQueMtx_, std::defer_lock);
+    lockTaskQueue(lock);
+    if (!isPoolRunning_ || boundedTaskCount() >= (size_t)taskQueMaxThreshHold_ ||
+        !hasByteBudget(footprint))
+    {
+        return false;
+    }
+    enqueueTask(lock, myTask(std::move(task), 0, Clock::time_point::max(), footprint, &flows_[0]));
+    return true;
+}
+
+void ThreadPool::activateFlow(TaskFlow *flow)
+{
+    flow->active = true;
+    flow->nextActive = nullptr;
+    if (activeTail_ != nullptr)
+    {
+        activeTail_->nextActive = flow;
+    }
+    else
+    {
+        activeHead_ = flow;
+    }
+    activeTail_ = flow;
+}
+
+bool ThreadPool::popTask(myTask &task)
+{
+    TaskFlow *flow = activeHead_;
+    if (flow == nullptr)
+    {
+        return false;
+    }
+
+    // 差额轮转: 轮到该执行器时获得 weight 个任务的额度
+    if (flow->deficit == 0)
+    {
+        flow->deficit = flow->weight;
+    }
+    task = std::move(const_cast<myTask &>(flow->queue.top()));
+    flow->queue.pop();
+    queuedTaskSize_--;
+    flow->deficit--;
+    flow->running.fetch_add(1, std::memory_order_relaxed);
+
+    if (flow->deficit > 0 && flow->runnable())
+    {
+        // 额度未用完, 留在链表头
+        return true;
+    }
+
+    // 移出链表头; 仍可执行且额度用完时排到链表尾
+    activeHead_ = flow->nextActive;
+    if (activeHead_ == nullptr)
+    {
+        activeTail_ = nullptr;
+    }
+    flow->active = false;
+    if (flow->queue.empty())
+    {
+        flow->deficit = 0;
+    }
+    else if (flow->runnable())
+    {
+        activateFlow(flow);
+    }
+    // 其余情况: 达到并发上限, 任务完成后由 finishTask 重新加入
+    return true;
+}
+
+void ThreadPool::finishTask(TaskFlow *flow)
+{
+    if (flow == nullptr)
+    {
+        return; // 亲和任务不属于任何执行器
+    }
+    flow->completedTasks.fetch_add(1, std::memory_order_relaxed);
+    if (flow->maxConcurrency == 0)
+    {
+        // 不限并发的执行器不会因为任务完成而变得可执行, 无需加锁
+        // release: 租户队列可能在 running 归零后被回收, 之前对它的访问必须先于回收
+        flow->running.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(taskQueMtx_, std::defer_lock);
+    lockTaskQueue(lock);
+    flow->running.fetch_sub(1, std::memory_order_relaxed);
+    // 该执行器之前可能因并发上限而有任务积压
+    if (!flow->active && flow->runnable())
+    {
+        activateFlow(flow);
+        if (notEmptyWaiters_ > 0)
+        {
+            notifyOne(notEmpty);
+        }
+        else if (reactorLeaderWaiting_)
+        {
+            wakeReactor();
+        }
+    }
+}
+
+ThreadPool::TaskFlow *ThreadPool::findTenantFlow(uint64_t tenant)
+{
+    auto it = tenantFlows_.find(tenant);
+    if (it != tenantFlows_.end())
+    {
+        return it->second;
+    }
+    // 租户 key 可能来自请求数据, 表增长到上次回收后的两倍时清理空闲租户, 均摊 O(1)
+    if (tenantFlows_.size() >= tenantSweepAt_)
+    {
+        releaseIdleTenantFlows();
+        tenantSweepAt_ = std::max(TENANT_SWEEP_MIN, tenantFlows_.size() * 2);
+    }
+
+    std::pmr::polymorphic_allocator<TaskFlow> alloc(memoryResource_);
+    TaskFlow *flow = alloc.allocate(1);
+    try
+    {
+        new (flow) TaskFlow({}, 1, 0, schedulePolicy_, memoryResource_);
+    }
+    catch (...)
+    {
+        alloc.deallocate(flow, 1);
+        throw;
+    }
+    try
+    {
+        tenantFlows_.emplace(tenant, flow);
+    }
+    catch (...)
+    {
+        destroyTenantFlow(flow);
+        throw;
+    }
+    auto retired = retiredTenants_.find(tenant);
+    if (retired != retiredTenants_.end())
+    {
+        flow->submittedTasks.store(retired->second.submitted, std::memory_order_relaxed);
+        flow->completedTasks.store(retired->second.completed, std::memory_order_relaxed);
+        retiredTenants_.erase(retired);
+    }
+    return flow;
+}
+
+void ThreadPool::releaseIdleTenantFlows()
+{
+    for (auto it = tenantFlows_.begin(); it != tenantFlows_.end();)
+    {
+        TaskFlow *flow = it->second;
+        // running 只在锁内增加, 队列为空且 running 为 0 时不会再有任务引用该队列;
+        // 设置过权重或并发上限的租户保留配置, 不回收
+        if (flow->queue.empty() && !flow->active &&
+            flow->running.load(std::memory_order_acquire) == 0 &&
+            flow->weight == 1 && flow->maxConcurrency == 0)
+        {
+            // 累计计数移入 retiredTenants_, 无法保存时保留该队列
+            try
+            {
+                retiredTenants_.emplace(it->first, TenantCounters{flow->submittedTasks.load(std::memory_order_relaxed),
+                                                                  flow->completedTasks.load(std::memory_order_relaxed)});
+            }
+            catch (...)
+            {
+                ++it;
+                continue;
+            }
+            it = tenantFlows_.erase(it);
+            destroyTenantFlow(flow);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void ThreadPool::destroyTenantFlow(TaskFlow *flow)
+{
+    std::pmr::polymorphic_allocator<TaskFlow> alloc(memoryResource_);
+    flow->~TaskFlow();
+    alloc.deallocate(flow, 1);
+}
+
+TaskFlowStats ThreadPool::flowStats(const TaskFlow &flow) const
+{
+    TaskFlowStats stats;
+    stats.submitted = flow.submittedTasks.load(std::memory_order_relaxed);
+    stats.completed = flow.completedTasks.load(std::memory_order_relaxed);
+    stats.queued = flow.queue.size();
+    stats.running = flow.running.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void ThreadPool::threadFunc(int threadid)
+{
+    auto lastTime = std::chrono::high_resolution_clock::now();
+    // 本线程的空闲计数分片
+    std::atomic_int &idleThreadSize = idleThreadShards_[threadid % COUNTER_SHARDS].value;
+    currentPool_ = this;
+    workerIndex_ = threadid;
+    countStat(&StatsShard::threadsSpawned);
+#if defined(__linux__)
+    if (!workerCpu_.empty() && workerCpu_[threadid] >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(workerCpu_[threadid], &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set); // 失败时不绑核, 仍可正常运行
+    }
+#endif
+
+    while (true)
+    {
+        myTask aTask;
+        // 先执行上次批量取出的任务, 无需获取队列锁
+        if (taskBatches_ && takeBatchedTask(threadid, aTask))
+        {
+            notifySpaceFreed();
+            runTask(aTask);
+            lastTime = std::chrono::high_resolution_clock::now();
+            continue;
+        }
+        // 其次是按 key 分配给本线程的亲和任务
+        if (takeAffinityTask(threadid, aTask))
+        {
+            notifySpaceFreed();
+            runTask(aTask);
+            lastTime = std::chrono::high_resolution_clock::now();
+            continue;
+        }
+        {
+            // 获取锁
+            std::unique_lock<std::mutex> lock(taskQueMtx_, std::defer_lock);
+            lockTaskQueue(lock);
+
+            idleThreadSize.fetch_add(1, std::memory_order_relaxed);
+
+            // 等待可执行的任务或停止信号; 队列为空时从其他线程的缓冲区窃取
+            // stolen: 任务不是从共享队列取出的, 不再批量填充
+            bool stolen = false;
+            Clock::time_point idleSince; // 开始等待任务的时间, 计入空闲时间统计
+            while (!popTask(aTask))
+            {
+                if (idleSince == Clock::time_point())
+                {
+                    idleSince = statsNow();
+                }
+                if (taskBatches_ && stealBatchedTask(threadid, aTask))
+                {
+                    stolen = true;
+                    break;
+                }
+                // 入队在 taskQueMtx_ 内完成, 此处检查后再等待不会错过唤醒
+                if (takeAffinityTask(threadid, aTask) || stealAffinityTask(threadid, aTask))
+                {
+                    stolen = true;
+                    break;
+                }
+
+                // 检查是否应该停止: 所有执行器的任务都已取完
+                if (!isPoolRunning_ && queuedTaskSize_ == 0)
+                {
+                    idleThreadSize.fetch_sub(1, std::memory_order_relaxed);
+                    curThreadSize_--;
+                    std::cout << "threadid:" << std::this_thread::get_id() << " exit (pool stopped)" << std::endl;
+                    return; // 由 shutdown() join
+                }
+
+                // 阻塞区域结束后多出的补偿线程直接退出; 拥有亲和队列的初始线程不退出
+                if (curThreadSize_ > threadLimit() && threadid >= affinityQueueCount_ && isPoolRunning_)
+                {
+                    releaseSlot(threadid);
+                    curThreadSize_--;
+                    idleThreadSize.fetch_sub(1, std::memory_order_relaxed);
+                    countStat(&StatsShard::threadsReaped);
+                    return;
+                }
+
+                // 先自旋一段时间, 避免短间隔到达的任务付出阻塞/唤醒的开销
+                // 队列非空但执行器都已达到并发上限时不自旋, 直接等待任务完成的通知
+                if ((spinCount_ > 0 || yieldCount_ > 0) && queuedTaskSize_ == 0)
+                {
+                    spinWait(lock, threadid);
+                    if (queuedTaskSize_ > 0 || !isPoolRunning_ || hasAffinityTask(threadid))
+                    {
+                        continue;
+                    }
+                }
+#if defined(__linux__)
+                // 事件循环模式: 没有 leader 时由本线程在 epoll 上等待, 其余空闲线程作为 follower 等待 notEmpty
+                if (reactorActive_ && !reactorLeaderWaiting_ && isPoolRunning_ && queuedTaskSize_ == 0)
+                {
+                    // 作为 leader 时可能在本线程上执行 handler, 不计入空闲时间
+                    countElapsed(&StatsShard::idleNanos, idleSince);
+                    setOwnerWaiting(threadid, true);
+                    runReactor(lock, threadid, idleThreadSize);
+                    setOwnerWaiting(threadid, false);
+                    idleSince = statsNow();
+                    lastTime = std::chrono::high_resolution_clock::now();
+                    continue;
+                }
+#endif
+                if (poolMode_ == PoolMode::MODE_CACHED)
+                {
+                    // cached模式下，空闲线程等待时间超过指定时间则结束该线程
+                    notEmptyWaiters_++;
+                    setOwnerWaiting(threadid, true);
+                    std::cv_status status = notEmpty.wait_for(lock, std::chrono::seconds(1));
+                    setOwnerWaiting(threadid, false);
+                    notEmptyWaiters_--;
+                    if (std::cv_status::timeout == status)
+                    {
+                        auto now = std::chrono::high_resolution_clock::now();
+                        auto dur = std::chrono::duration_cast<std::chrono::seconds>(now - lastTime);
+                        if (dur.count() >= THREAD_MAX_IDLE_TIME && curThreadSize_ > initThreadSize_ &&
+                            threadid >= affinityQueueCount_ && isPoolRunning_)
+                        {
+                            // 回收线程: 先归还槽位再减少计数, 保证 curThreadSize_ 不超过空闲槽位数
+                            releaseSlot(threadid);
+                            curThreadSize_--;
+                            idleThreadSize.fetch_sub(1, std::memory_order_relaxed);
+                            countStat(&StatsShard::threadsReaped);
+                            std::cout << "threadid:" << std::this_thread::get_id() << " exit" << std::endl;
+                            return;
+                        }
+                    }
+                }
+                else
+                {
+                    // 等待任务队列非空
+                    notEmptyWaiters_++;
+                    setOwnerWaiting(threadid, true);
+                    notEmpty.wait(lock);
+                    setOwnerWaiting(threadid, false);
+                    notEmptyWaiters_--;
+                }
+            }
+
+            idleThreadSize.fetch_sub(1, std::memory_order_relaxed);
+            countElapsed(&StatsShard::idleNanos, idleSince);
+
+            if (taskBatches_ && !stolen)
+            {
+                fillTaskBatch(threadid);
+            }
+
+            // 通知其他线程还有任务 (仅当有线程在等待时)
+            if (queuedTaskSize_ > 0 && shouldNotify(notEmptyWaiters_))
+            {
+                notifyOne(notEmpty);
+            }
+            else if (queuedTaskSize_ > 0 && reactorLeaderWaiting_)
+            {
+                wakeReactor();
+            }
+
+            // 通知生产者任务队列有空余 (仅当有生产者阻塞时)
+            if (shouldNotify(notFullWaiters_))
+            {
+                notifyOne(notFull);
+            }
+        } // 释放锁
+
+        // 执行任务
+        runTask(aTask);
+        lastTime = std::chrono::high_resolution_clock::now();
+    }
+}
+
+void ThreadPool::runTask(myTask &aTask)
+{
+    if (!aTask.task)
+    {
+        return;
+    }
+    Clock::time_point begin = statsNow();
+    if (begin != Clock::time_point() && aTask.enqueued_ != Clock::time_point())
+    {
+        countLatency(&StatsShard::queueWaitBuckets, &StatsShard::queueWaitNanos, begin - aTask.enqueued_);
+    }
+    if (aTask.isExpired())
+    {
+        // 已超过截止时间, 不再执行
+        expiredTaskCount_++;
+        aTask.task->expire();
+    }
+    else
+    {
+        aTask.task->execute();
+    }
+    countStat(&StatsShard::completed);
+    if (begin != Clock::time_point())
+    {
+        countLatency(&StatsShard::runTimeBuckets, &StatsShard::runTimeNanos, Clock::now() - begin);
+    }
+    // 任务节点 (及其捕获的数据) 销毁后才归还字节预算
+    aTask.task.reset();
+    releaseTaskBytes(aTask.footprint_);
+    finishTask(aTask.flow_);
+}
+
+bool ThreadPool::runQueuedTask()
+{
+    myTask aTask;
+    int index = isWorkerThread() ? workerIndex_ : -1;
+    // 等待的结果可能就在自己的缓冲区或亲和队列中, 先取自己的, 再取队列, 最后窃取
+    bool ownTask = (taskBatches_ && index >= 0 && takeBatchedTask(index, aTask)) || takeAffinityTask(index, aTask);
+    if (ownTask)
+    {
+        notifySpaceFreed();
+    }
+    if (!ownTask)
+    {
+        std::unique_lock<std::mutex> lock(taskQueMtx_, std::defer_lock);
+        lockTaskQueue(lock);
+        if (!popTask(aTask) && !(taskBatches_ && stealBatchedTask(index, aTask)) &&
+            !stealAffinityTask(index, aTask))
+        {
+            return false;
+        }
+        if (notFullWaiters_ > 0)
+        {
+            notifyOne(notFull);
+        }
+    }
+    runTask(aTask);
+    return true;
+}
+
+void ThreadPool::fillTaskBatch(int index)
+{
+    // 有空闲线程时少取, 把剩余任务留给它们
+    size_t idle = (size_t)getIdleThreadCount();
+    size_t extra = std::min((size_t)taskBatchSize_ - 1, queuedTaskSize_ / (idle + 1));
+    if (extra == 0)
+    {
+        return;
+    }
+
+    TaskBatch &batch = taskBatches_[index];
+    std::lock_guard<std::mutex> guard(batch.mtx);
+    int count = batch.size.load(std::memory_order_relaxed);
+    size_t taken = 0;
+    while (taken < extra && count < MAX_TASK_BATCH && popTask(batch.tasks[(batch.head + count) % MAX_TASK_BATCH]))
+    {
+        count++;
+        taken++;
+    }
+    batch.size.store(count, std::memory_order_relaxed);
+    // 缓冲区中的任务仍计入队列上限, 移入缓冲区不腾出位置; 任务被取出执行时才通知生产者
+    batchedTaskSize_.fetch_add(taken, std::memory_order_relaxed);
+}
+
+bool ThreadPool::takeBatchedTask(int index, myTask &task)
+{
+    TaskBatch &batch = taskBatches_[index];
+    if (batch.size.load(std::memory_order_relaxed) == 0)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(batch.mtx);
+    int count = batch.size.load(std::memory_order_relaxed);
+    if (count == 0)
+    {
+        return false;
+    }
+    task = std::move(batch.tasks[batch.head]);
+    batch.head = (batch.head + 1) % MAX_TASK_BATCH;
+    batch.size.store(count - 1, std::memory_order_relaxed);
+    batchedTaskSize_.fetch_sub(1); // 与 waitForSpace 中的登记配对, 见 notifySpaceFreed
+    return true;
+}
+
+bool ThreadPool::stealBatchedTask(int index, myTask &task)
+{
+    if (batchedTaskSize_.load(std::memory_order_relaxed) == 0)
+    {
+        return false;
+    }
+    if (groupSlots_.empty() || index < 0)
+    {
+        for (int i = 1; i <= threadCapacity_; i++)
+        {
+            if (stealBatchedFrom((index + i + threadCapacity_) % threadCapacity_, task, 0))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 先在共享 L3 的分组内窃取
+    int group = workerGroup_[index];
+    for (int victim : groupSlots_[group])
+    {
+        if (victim != index && stealBatchedFrom(victim, task, 0))
+        {
+            return true;
+        }
+    }
+    // 跨分组窃取的代价高: 对方缓冲区只剩一个任务时留给它自己在本地缓存中执行
+    for (int i = 1; i < threadCapacity_; i++)
+    {
+        int victim = (index + i) % threadCapacity_;
+        if (workerGroup_[victim] != group && stealBatchedFrom(victim, task, 1))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::stealBatchedFrom(int victim, myTask &task, int minCount)
+{
+    TaskBatch &batch = taskBatches_[victim];
+    if (batch.size.load(std::memory_order_relaxed) <= minCount)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(batch.mtx);
+    int count = batch.size.load(std::memory_order_relaxed);
+    if (count <= minCount)
+    {
+        return false;
+    }
+    task = std::move(batch.tasks[(batch.head + count - 1) % MAX_TASK_BATCH]);
+    batch.size.store(count - 1, std::memory_order_relaxed);
+    batchedTaskSize_.fetch_sub(1); // 与 waitForSpace 中的登记配对, 见 notifySpaceFreed
+    return true;
+}
+
+bool ThreadPool::pushAffinityTask(int index, myTask &&task)
+{
+    size_t footprint = task.footprint_;
+    AffinityQueue &queue = affinityQueues_[index];
+    // 与共享队列一样在锁内检查, 关闭后入队的任务将不会再被执行
+    if (!isPoolRunning_)
+    {
+        throw std::runtime_error("ThreadPool is shutting down, no new tasks accepted.");
+    }
+
+    int size;
+    {
+        std::lock_guard<std::mutex> guard(queue.mtx);
+        task.enqueued_ = statsNow();
+        queue.tasks.push_back(std::move(task));
+        size = queue.size.load(std::memory_order_relaxed) + 1;
+        queue.size.store(size, std::memory_order_relaxed);
+    }
+    affinityTaskSize_.fetch_add(1, std::memory_order_relaxed);
+    outstandingTaskBytes_ += footprint;
+    countStat(&StatsShard::submitted);
+
+    if (queue.ownerWaiting)
+    {
+        // 条件变量无法指定唤醒哪个线程, 所有者阻塞时只能全部唤醒
+        if (notEmptyWaiters_ > 0)
+        {
+            notifyAll(notEmpty);
+        }
+        if (reactorLeaderWaiting_)
+        {
+            wakeReactor();
+        }
+    }
+    else if (affinityStealThreshHold_ > 0 && size > affinityStealThreshHold_ && notEmptyWaiters_ > 0)
+    {
+        // 所有者忙且队列过载, 唤醒一个线程来窃取
+        notifyOne(notEmpty);
+    }
+    // 只有超过窃取阈值的部分能由其他线程执行, 不允许窃取时增加线程没有意义
+    return affinityStealThreshHold_ > 0 && size > affinityStealThreshHold_ &&
+           reserveThread((size_t)(size - affinityStealThreshHold_));
 }
 
-void ThreadPool::setMode(PoolMode mode)
+bool ThreadPool::reserveThread(size_t backlog)
 {
-    if (checkRunningState())
+    if (isPoolRunning_ && backlog > (size_t)getIdleThreadCount() && curThreadSize_ < threadLimit())
     {
-        return;
+        // 锁内只做计数, 槽位分配与线程创建在锁外完成
+        curThreadSize_++;
+        pendingStartSize_++;
+        return true;
     }
-    poolMode_ = mode;
+    return false;
 }
 
-void ThreadPool::setPolicy(RejectionPolicy policy)
+bool ThreadPool::takeAffinityTask(int index, myTask &task)
 {
-    if (checkRunningState())
+    if (index < 0 || index >= affinityQueueCount_)
     {
-        return;
+        return false;
     }
-    rejectionPolicy_ = policy;
+    AffinityQueue &queue = affinityQueues_[index];
+    if (queue.size.load(std::memory_order_relaxed) == 0)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(queue.mtx);
+    if (queue.tasks.empty())
+    {
+        return false;
+    }
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    queue.size.store((int)queue.tasks.size(), std::memory_order_relaxed);
+    affinityTaskSize_.fetch_sub(1); // 与 waitForSpace 中的登记配对, 见 notifySpaceFreed
+    return true;
 }
 
-void ThreadPool::setTaskQueMaxThreshHold(int threshhold)
+bool ThreadPool::stealAffinityTask(int index, myTask &task)
 {
-    if (checkRunningState())
+    // 总数不超过阈值时不可能有队列过载
+    int threshhold = affinityStealThreshHold_;
+    if (threshhold == 0 || affinityTaskSize_.load(std::memory_order_relaxed) <= (size_t)threshhold)
     {
-        return;
+        return false;
     }
-    taskQueMaxThreshHold_ = threshhold;
+    // 拓扑感知时先窃取同一分组内的队列
+    if (!groupSlots_.empty() && index >= 0)
+    {
+        for (int victim : groupSlots_[workerGroup_[index]])
+        {
+            if (victim != index && victim < affinityQueueCount_ && stealAffinityFrom(victim, task))
+            {
+                return true;
+            }
+        }
+    }
+    for (int i = 0; i < affinityQueueCount_; i++)
+    {
+        if (i != index && stealAffinityFrom(i, task))
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
-void ThreadPool::setThreadSizeThreshHold(int threshhold)
+bool ThreadPool::stealAffinityFrom(int victim, myTask &task)
 {
-    if (checkRunningState())
+    int threshhold = affinityStealThreshHold_;
+    AffinityQueue &queue = affinityQueues_[victim];
+    if (queue.size.load(std::memory_order_relaxed) <= threshhold)
     {
-        return;
+        return false;
     }
-    if (poolMode_ == PoolMode::MODE_CACHED)
+    std::lock_guard<std::mutex> guard(queue.mtx);
+    if ((int)queue.tasks.size() <= threshhold)
     {
-        threadSizeThreshHold_ = threshhold;
+        return false;
     }
+    // 取最早提交的任务, 尽量保持提交顺序
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    queue.size.store((int)queue.tasks.size(), std::memory_order_relaxed);
+    affinityTaskSize_.fetch_sub(1);
+    return true;
 }
 
-void ThreadPool::start(int initThreadSize)
+bool ThreadPool::hasAffinityTask(int index) const
 {
-    // 设置线程池运行状态
-    isPoolRunning_ = true;
-    // 记录初始线程个数
-    initThreadSize_ = initThreadSize;
-    curThreadSize_ = initThreadSize;
+    return index >= 0 && index < affinityQueueCount_ &&
+           affinityQueues_[index].size.load(std::memory_order_relaxed) > 0;
+}
+
+void ThreadPool::setOwnerWaiting(int index, bool waiting)
+{
+    if (index < affinityQueueCount_)
+    {
+        affinityQueues_[index].ownerWaiting = waiting;
+    }
+}
 
-    for (int i = 0; i < initThreadSize_; i++)
+void ThreadPool::helpWhileWaiting(const std::function<bool(std::chrono::microseconds)> &ready)
+{
+    if (!isWorkerThread())
     {
-        auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-        int threadId = ptr->getId();
-        threads_.emplace(threadId, std::move(ptr));
+        return;
     }
-    // 启动线程
-    for (auto &pair : threads_)
+    // 队列为空时短暂等待结果, 之后再检查队列: 结果可能依赖于尚未提交的任务
+    std::chrono::microseconds backoff(50);
+    while (!ready(std::chrono::microseconds(0)))
     {
-        pair.second->start();
+        if (runQueuedTask())
+        {
+            backoff = std::chrono::microseconds(50);
+            continue;
+        }
+        if (ready(backoff))
+        {
+            return;
+        }
+        backoff = std::min(backoff * 2, std::chrono::microseconds(2000));
     }
 }
 
-void ThreadPool::shutdown()
+void ThreadPool::spinWait(std::unique_lock<std::mutex> &lock, int index)
 {
+    spinningThreadSize_++;
+    lock.unlock();
+
+    for (int i = 0; i < spinCount_ + yieldCount_; i++)
     {
-        std::unique_lock<std::mutex> lock(taskQueMtx_);
-        isPoolRunning_ = false;
-        notEmpty.notify_all();
+        if (queuedTaskSize_.load(std::memory_order_relaxed) > 0 || hasAffinityTask(index) ||
+            !isPoolRunning_.load(std::memory_order_relaxed))
+        {
+            break;
+        }
+        if (i < spinCount_)
+        {
+            cpuRelax();
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
     }
 
+    // 先减计数再加锁: 提交者在锁内看到计数为 0 时会负责唤醒
+    spinningThreadSize_--;
+    lock.lock();
+}
+
+ThreadPool::Executor ThreadPool::createExecutor(const std::string &name, int weight, int maxConcurrency)
+{
     std::unique_lock<std::mutex> lock(taskQueMtx_);
-    exitCond_.wait(lock, [&]() -> bool
-                   { return threads_.size() == 0; });
+    flows_.emplace_back(name, weight, maxConcurrency, schedulePolicy_, memoryResource_);
+    return Executor(this, (int)flows_.size() - 1);
 }
 
-int ThreadPool::getCurrentThreadCount() const
+ThreadPool::Strand ThreadPool::createStrand()
 {
-    return curThreadSize_;
+    // 状态与控制块一次分配, 来自任务内存资源
+    std::pmr::polymorphic_allocator<StrandState> alloc(taskResource_.get());
+    return Strand(this, std::allocate_shared<StrandState>(alloc, taskResource_.get()));
 }
 
-int ThreadPool::getIdleThreadCount() const
+size_t ThreadPool::Strand::getPendingTaskCount() const
 {
-    return idleThreadSize_;
+    return state_->pending.load(std::memory_order_relaxed);
 }
 
-int ThreadPool::getActiveThreadCount() const
+void ThreadPool::StrandState::freeNode(StrandNode *node)
 {
-    return curThreadSize_ - idleThreadSize_;
+    node->~StrandNode();
+    resource->deallocate(node, sizeof(StrandNode), alignof(StrandNode));
 }
 
-size_t ThreadPool::getTaskQueueSize()
+ThreadPool::StrandState::~StrandState()
 {
-    std::unique_lock<std::mutex> lock(taskQueMtx_);
-    return taskQue_.size();
+    StrandNode *node = head;
+    while (node != nullptr)
+    {
+        StrandNode *next = node->next.load(std::memory_order_relaxed);
+        if (node != &stub)
+        {
+            freeNode(node);
+        }
+        node = next;
+    }
 }
 
-void ThreadPool::threadFunc(int threadid)
+void ThreadPool::postToStrand(const std::shared_ptr<StrandState> &state, TaskPtr task)
 {
-    auto lastTime = std::chrono::high_resolution_clock::now();
+    // 与 scheduleStrand 相同的准入条件, 尽量在链接节点之前拒绝
+    if (!isPoolRunning_ && !isWorkerThread())
+    {
+        throw std::runtime_error("ThreadPool is shutting down, no new tasks accepted.");
+    }
+    void *mem = state->resource->allocate(sizeof(StrandNode), alignof(StrandNode));
+    StrandNode *node = new (mem) StrandNode();
+    node->task = myTask(std::move(task));
+    node->task.enqueued_ = statsNow();
+    countStat(&StatsShard::submitted);
 
-    while (true)
+    StrandNode *prev = state->tail.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+    if (state->pending.fetch_add(1, std::memory_order_acq_rel) == 0)
     {
-        myTask aTask;
+        // Strand 从空闲变为忙碌
+        try
         {
-            // 获取锁
-            std::unique_lock<std::mutex> lock(taskQueMtx_);
+            scheduleStrand(state);
+        }
+        catch (...)
+        {
+            // 检查之后线程池开始关闭, 或内存不足: 其他投递者看到 pending 非 0 而依赖本次调度,
+            // 须由本线程清空已链接的任务, 否则 Strand 永远卡在忙碌状态
+            discardStrand(*state);
+            throw;
+        }
+    }
+}
 
-            idleThreadSize_++;
+void ThreadPool::scheduleStrand(std::shared_ptr<StrandState> state)
+{
+    auto *rawTask = makeTask<void>([this, state = std::move(state)]
+                                   { drainStrand(state); });
+    TaskPtr task(rawTask, TaskDeleter(taskResource_.get()));
 
-            // 等待任务或停止信号
-            while (taskQue_.size() == 0)
-            {
-                // 检查是否应该停止
-                if (!isPoolRunning_)
-                {
-                    idleThreadSize_--;
-                    threads_.erase(threadid);
-                    curThreadSize_--;
-                    std::cout << "threadid:" << std::this_thread::get_id() << " exit (pool stopped)" << std::endl;
-                    exitCond_.notify_all();
-                    return;
-                }
+    std::unique_lock<std::mutex> lock(taskQueMtx_, std::defer_lock);
+    lockTaskQueue(lock);
+    // 关闭过程中工作线程仍在清空队列, 由它们继续调度的批次也须执行
+    if (!isPoolRunning_ && !isWorkerThread())
+    {
+        throw std::runtime_error("ThreadPool is shutting down, no new tasks accepted.");
+    }
+    pushTask(myTask(std::move(task), 0, Clock::time_point::max(), 0, &flows_[0]));
+    if (notEmptyWaiters_ > 0 && (size_t)spinningThreadSize_ < queuedTaskSize_)
+    {
+        notifyOne(notEmpty);
+    }
+    else if (reactorLeaderWaiting_)
+    {
+        wakeReactor();
+    }
 
-                if (poolMode_ == PoolMode::MODE_CACHED)
-                {
-                    // cached模式下，空闲线程等待时间超过指定时间则结束该线程
-                    if (std::cv_status::timeout ==
-                        notEmpty.wait_for(lock, std::chrono::seconds(1)))
-                    {
-                        auto now = std::chrono::high_resolution_clock::now();
-                        auto dur = std::chrono::duration_cast<std::chrono::seconds>(now - lastTime);
-                        if (dur.count() >= THREAD_MAX_IDLE_TIME && curThreadSize_ > initThreadSize_)
-                        {
-                            // 回收线程
-                            threads_.erase(threadid);
-                            curThreadSize_--;
-                            idleThreadSize_--;
-                            std::cout << "threadid:" << std::this_thread::get_id() << " exit" << std::endl;
-                            exitCond_.notify_all();
-                            return;
-                        }
-                    }
-                }
-                else
-                {
-                    // 等待任务队列非空
-                    notEmpty.wait(lock);
-                }
-            }
+    bool needNewThread = reserveThread(queuedTaskSize_);
+    lock.unlock();
+
+    if (needNewThread)
+    {
+        spawnThread();
+    }
+}
+
+ThreadPool::myTask ThreadPool::popStrandTask(StrandState &state)
+{
+    StrandNode *head = state.head;
+    StrandNode *next = head->next.load(std::memory_order_acquire);
+    // 投递者已交换 tail 但尚未链接节点
+    for (int spins = 0; next == nullptr; spins++)
+    {
+        if (spins < 64)
+        {
+            cpuRelax();
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+        next = head->next.load(std::memory_order_acquire);
+    }
 
-            idleThreadSize_--;
-            // 获取任务
-            aTask = std::move(const_cast<myTask &>(taskQue_.top()));
-            taskQue_.pop();
+    // next 成为新的哨兵节点
+    myTask task = std::move(next->task);
+    state.head = next;
+    if (head != &state.stub)
+    {
+        state.freeNode(head);
+    }
+    return task;
+}
 
-            // 通知其他线程还有任务
-            if (taskQue_.size() > 0)
+void ThreadPool::drainStrand(const std::shared_ptr<StrandState> &state)
+{
+    while (true)
+    {
+        for (int i = 0; i < STRAND_MAX_BATCH; i++)
+        {
+            myTask task = popStrandTask(*state);
+            runTask(task);
+            if (state->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
             {
-                notEmpty.notify_one();
+                return;
             }
+        }
+        // 仍有任务: 重新排到队尾, 让其他任务与 Strand 有机会执行
+        try
+        {
+            scheduleStrand(state);
+            return;
+        }
+        catch (...)
+        {
+            // 工作线程上只会因内存不足而失败: 在本线程继续执行下一批
+        }
+    }
+}
 
-            // 通知生产者任务队列有空余
-            notFull.notify_one();
-        } // 释放锁
+void ThreadPool::discardStrand(StrandState &state)
+{
+    do
+    {
+        myTask task = popStrandTask(state);
+        countStat(&StatsShard::rejected);
+        countStat(&StatsShard::discarded);
+    } while (state.pending.fetch_sub(1, std::memory_order_acq_rel) != 1);
+}
 
-        // 执行任务
-        if (aTask.task)
+std::string ThreadPool::Executor::getName() const
+{
+    std::unique_lock<std::mutex> lock(pool_->taskQueMtx_);
+    return std::string(pool_->flows_[id_].name);
+}
+
+size_t ThreadPool::Executor::getTaskQueueSize() const
+{
+    std::unique_lock<std::mutex> lock(pool_->taskQueMtx_);
+    return pool_->flows_[id_].queue.size();
+}
+
+int ThreadPool::Executor::getRunningTaskCount() const
+{
+    std::unique_lock<std::mutex> lock(pool_->taskQueMtx_);
+    return pool_->flows_[id_].running.load(std::memory_order_relaxed);
+}
+
+TaskFlowStats ThreadPool::Executor::getStats() const
+{
+    std::unique_lock<std::mutex> lock(pool_->taskQueMtx_);
+    return pool_->flowStats(pool_->flows_[id_]);
+}
+
+void ThreadPool::setTenantWeight(uint64_t tenant, int weight, int maxConcurrency)
+{
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    TaskFlow *flow = findTenantFlow(tenant);
+    flow->weight = std::max(1, weight);
+    flow->maxConcurrency = std::max(0, maxConcurrency);
+    flow->deficit = std::min(flow->deficit, flow->weight);
+}
+
+TaskFlowStats ThreadPool::getTenantStats(uint64_t tenant)
+{
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    auto it = tenantFlows_.find(tenant);
+    if (it == tenantFlows_.end())
+    {
+        TaskFlowStats stats;
+        auto retired = retiredTenants_.find(tenant);
+        if (retired != retiredTenants_.end())
         {
-            aTask.task->execute();
+            stats.submitted = retired->second.submitted;
+            stats.completed = retired->second.completed;
         }
-        lastTime = std::chrono::high_resolution_clock::now();
+        return stats;
     }
+    return flowStats(*it->second);
 }
 
+ThreadPool::TaskFlow::TaskFlow(std::string_view n, int w, int maxConc, SchedulePolicy policy,
+                               std::pmr::memory_resource *resource)
+    : name(n, resource),
+      queue(TaskCompare{policy}, std::pmr::polymorphic_allocator<myTask>(resource)),
+      weight(std::max(1, w)),
+      maxConcurrency(std::max(0, maxConc)),
+      running(0),
+      deficit(0),
+      active(false),
+      nextActive(nullptr) {}
+
 bool ThreadPool::checkRunningState() const
 {
     return isPoolRunning_;
@@ -200,18 +2795,213 @@ bool ThreadPool::checkRunningState() const
 
 // ======== Thread 类实现 (已添加作用域) =========
 
-std::atomic_int ThreadPool::Thread::generateId_ = 0;
+ThreadPool::Thread::~Thread()
+{
+    join();
+}
 
-ThreadPool::Thread::Thread(ThreadFunc func)
-    : func_(func), threadId_(generateId_.fetch_add(1)) {}
+void ThreadPool::Thread::start(ThreadFunc func, int threadId)
+{
+    threadId_ = threadId;
+    thread_ = std::thread(std::move(func), threadId);
+}
 
-void ThreadPool::Thread::start()
+void ThreadPool::Thread::join()
 {
-    std::thread t(func_, threadId_);
-    t.detach();
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
 }
 
 int ThreadPool::Thread::getId() const
 {
     return threadId_;
-}
\ No newline at end of file
+}
+#if defined(__linux__)
+std::future<long> ThreadPool::readAsync(int fd, void *buf, size_t len, int64_t offset)
+{
+    IoRequest *request = new IoRequest{false, {buf, len}, nullptr, {}};
+    std::future<long> result = request->promise.get_future();
+    submitIo(request, fd, offset);
+    return result;
+}
+
+std::future<long> ThreadPool::writeAsync(int fd, const void *buf, size_t len, int64_t offset)
+{
+    IoRequest *request = new IoRequest{true, {const_cast<void *>(buf), len}, nullptr, {}};
+    std::future<long> result = request->promise.get_future();
+    submitIo(request, fd, offset);
+    return result;
+}
+
+void ThreadPool::readAsync(int fd, void *buf, size_t len, int64_t offset, std::function<void(long)> callback)
+{
+    submitIo(new IoRequest{false, {buf, len}, std::move(callback), {}}, fd, offset);
+}
+
+void ThreadPool::writeAsync(int fd, const void *buf, size_t len, int64_t offset, std::function<void(long)> callback)
+{
+    submitIo(new IoRequest{true, {const_cast<void *>(buf), len}, std::move(callback), {}}, fd, offset);
+}
+
+bool ThreadPool::isIoUringEnabled()
+{
+    std::call_once(ioRingOnce_, [this]
+                   { ioRing_ = IoRing::create(this, IO_RING_ENTRIES); });
+    return ioRing_ != nullptr;
+}
+
+void ThreadPool::submitIo(IoRequest *request, int fd, int64_t offset)
+{
+    if (!isPoolRunning_)
+    {
+        delete request;
+        throw std::runtime_error("ThreadPool is shutting down, no new tasks accepted.");
+    }
+    if (isIoUringEnabled() && ioRing_->submit(request, fd, offset))
+    {
+        return;
+    }
+
+    try
+    {
+        submitBlocking([this, request, fd, offset]
+                       {
+            long result = request->write ? pwrite(fd, request->iov.iov_base, request->iov.iov_len, offset)
+                                         : pread(fd, request->iov.iov_base, request->iov.iov_len, offset);
+            completeIo(request, result < 0 ? -errno : result); });
+    }
+    catch (...)
+    {
+        delete request;
+        throw;
+    }
+}
+
+void ThreadPool::completeIo(IoRequest *request, long result)
+{
+    std::unique_ptr<IoRequest> owner(request);
+    if (!request->callback)
+    {
+        request->promise.set_value(result);
+        return;
+    }
+    // 在收割线程上调用, 不能等待队列空位: 入队失败 (队列已满或线程池正在关闭) 时就地执行回调
+    auto *rawTask = makeTask<void>([callback = request->callback, result]
+                                   { callback(result); });
+    TaskPtr task(rawTask, TaskDeleter(taskResource_.get()));
+    if (!tryEnqueueTask(std::move(task), sizeof(*rawTask)))
+    {
+        request->callback(result);
+    }
+}
+#endif
+
+#if defined(__linux__)
+void ThreadPool::addFd(int fd, uint32_t events, std::function<void(uint32_t)> handler)
+{
+    std::call_once(reactorOnce_, [this]
+                   { reactor_ = std::make_unique<Reactor>(); });
+    reactor_->add(fd, events, std::move(handler));
+
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    if (!reactorActive_)
+    {
+        // 让一个空闲线程成为 leader
+        reactorActive_ = true;
+        if (notEmptyWaiters_ > 0)
+        {
+            notifyOne(notEmpty);
+        }
+    }
+}
+
+void ThreadPool::modifyFd(int fd, uint32_t events)
+{
+    if (!reactor_)
+    {
+        throw std::invalid_argument("fd is not registered");
+    }
+    reactor_->modify(fd, events);
+}
+
+void ThreadPool::removeFd(int fd)
+{
+    if (reactor_)
+    {
+        reactor_->remove(fd);
+    }
+}
+
+void ThreadPool::runReactor(std::unique_lock<std::mutex> &lock, int threadid, std::atomic_int &idleThreadSize)
+{
+    reactorLeaderWaiting_ = true;
+    lock.unlock();
+
+    epoll_event events[REACTOR_MAX_EVENTS];
+    int count = reactor_->wait(events, REACTOR_MAX_EVENTS);
+
+    lock.lock();
+    reactorLeaderWaiting_ = false;
+    if (count == 0)
+    {
+        // 被提交的任务或 shutdown 唤醒
+        return;
+    }
+    // 处理事件前退出空闲计数并交出 leader 身份: handler 执行期间提交的任务据此唤醒或创建线程,
+    // 由一个 follower 接替等待; 没有 follower 时按需创建一个线程
+    idleThreadSize.fetch_sub(1, std::memory_order_relaxed);
+    setOwnerWaiting(threadid, false);
+    bool needNewThread = false;
+    if (notEmptyWaiters_ > 0)
+    {
+        notifyOne(notEmpty);
+    }
+    else if (isPoolRunning_ && getIdleThreadCount() == 0 && curThreadSize_ < threadLimit())
+    {
+        curThreadSize_++;
+        pendingStartSize_++;
+        needNewThread = true;
+    }
+    lock.unlock();
+    if (needNewThread)
+    {
+        spawnThread();
+    }
+
+    // 第一个事件在本线程直接处理, 其余作为任务交给其他线程
+    // 不等待队列空位也不走拒绝策略: 队列已满或线程池正在关闭时在本线程处理
+    for (int i = 1; i < count; i++)
+    {
+        int fd = events[i].data.fd;
+        uint32_t ready = events[i].events;
+        bool queued = false;
+        try
+        {
+            auto *rawTask = makeTask<void>([this, fd, ready]
+                                           { reactor_->dispatch(fd, ready); });
+            queued = tryEnqueueTask(TaskPtr(rawTask, TaskDeleter(taskResource_.get())), sizeof(*rawTask));
+        }
+        catch (...)
+        {
+            // 分配任务失败, 同样在本线程处理
+        }
+        if (!queued)
+        {
+            reactor_->dispatch(fd, ready);
+        }
+    }
+    reactor_->dispatch(events[0].data.fd, events[0].events);
+
+    lock.lock();
+    idleThreadSize.fetch_add(1, std::memory_order_relaxed);
+}
+#endif
+
+void ThreadPool::wakeReactor()
+{
+#if defined(__linux__)
+    reactor_->wake();
+#endif
+}
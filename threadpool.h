@@ -8,10 +8,22 @@
 #include <mutex>
 #include <condition_variable>
 #include <functional>
+#include <cstdint>
 #include <unordered_map>
 #include <thread>
 #include <future>
+#include <memory_resource>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <chrono>
+#include <stdexcept>
 #include <iostream>
+#include <array>
+#include <new>
+#include <algorithm>
+#include <exception>
 
 enum class PoolMode
 {
@@ -26,18 +38,165 @@ enum class RejectionPolicy
     CallerRuns // 在提交任务的那个线程上直接执行该任务
 };
 
+enum class SchedulePolicy
+{
+    Priority, // 按优先级调度(默认)
+    EDF       // 最早截止时间优先, 截止时间相同时再按优先级
+};
+
+// 提交任务时的可选参数
+struct TaskOptions
+{
+    int priority = 0; // 优先级, 越大越先执行
+    // 截止时间, max 表示不限
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    size_t footprint = 0; // 任务占用的内存字节数, 0 表示按任务节点大小估算
+    int executor = 0;     // 目标执行器 id, 0 为线程池的默认执行器
+    uint64_t tenant = 0;  // 租户 key, 非 0 时任务进入该租户自己的队列 (此时忽略 executor)
+};
+
+// 执行器或租户的吞吐统计
+struct TaskFlowStats
+{
+    uint64_t submitted = 0; // 累计入队的任务数
+    uint64_t completed = 0; // 累计执行完毕 (含过期) 的任务数
+    size_t queued = 0;      // 当前排队的任务数
+    int running = 0;        // 当前正在执行的任务数
+};
+
+// 线程池运行统计, 由 getStats() 汇总; 编译时定义 THREADPOOL_STATS=0 可去掉全部计数, 此时累计项均为 0
+// THREADPOOL_STATS 会改变 ThreadPool 的成员布局, 所有包含本头文件的翻译单元及 threadpool.cpp 须使用相同的取值,
+// 否则违反 ODR, 行为未定义 (通常表现为内存越界)
+#ifndef THREADPOOL_STATS
+#define THREADPOOL_STATS 1
+#endif
+
+// 延迟直方图: 各桶为非累计计数, 桶上界见 BOUNDS_NS, 最后一个桶为 +Inf
+struct LatencyHistogram
+{
+    static constexpr int BUCKETS = 23;
+    static constexpr std::array<int64_t, BUCKETS - 1> BOUNDS_NS = {
+        1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,                      // 1µs - 500µs
+        1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000, 250000000, 500000000, // 1ms - 500ms
+        1000000000, 2500000000, 5000000000, 10000000000};                                  // 1s - 10s
+
+    std::array<uint64_t, BUCKETS> counts{};
+    std::chrono::nanoseconds sum{0};
+
+    uint64_t count() const
+    {
+        uint64_t total = 0;
+        for (uint64_t c : counts)
+        {
+            total += c;
+        }
+        return total;
+    }
+};
+
+struct PoolStats
+{
+    uint64_t submitted = 0;      // 累计入队的任务数
+    uint64_t completed = 0;      // 累计由工作线程执行完毕 (含过期) 的任务数
+    uint64_t rejected = 0;       // 队列满时应用拒绝策略的次数 (含下面两项)
+    uint64_t callerRuns = 0;     // 其中由提交者线程执行的任务数
+    uint64_t discarded = 0;      // 其中被丢弃的任务数
+    uint64_t threadsSpawned = 0; // 累计启动的工作线程数
+    uint64_t threadsReaped = 0;  // 累计因空闲超时或阻塞区域结束而退出的线程数
+    uint64_t notifies = 0;       // 累计对 notEmpty/notFull 发出的通知次数
+    std::chrono::nanoseconds idleTime{0};     // 工作线程累计等待任务的时间, 每次等待结束时计入
+    std::chrono::nanoseconds lockWaitTime{0}; // 累计等待 taskQueMtx_ 的时间
+    size_t maxQueueDepth = 0;                 // 共享队列的最大排队任务数
+    LatencyHistogram queueWait; // 任务从入队到开始执行的时间
+    LatencyHistogram runTime;   // 任务的执行时间
+    // 以下为调用时的快照
+    int currentThreads = 0;
+    int idleThreads = 0;
+    size_t queuedTasks = 0; // 共享队列, 批量缓冲区与亲和队列中的任务数
+};
+
+// 任务在截止时间之后才被取出时, 不再执行, 其 future 抛出该异常
+class TaskExpiredError : public std::runtime_error
+{
+public:
+    TaskExpiredError() : std::runtime_error("Task expired before execution") {}
+};
+
+class ThreadPool;
+
+// 线程池任务的 future: 在本线程池的工作线程中调用 get()/wait() 时, 等待期间先执行队列中的其他任务,
+// 避免嵌套提交的任务因所有工作线程都在等待而死锁; 在其他线程中与 std::future 相同
+template <typename R>
+class TaskFuture : public std::future<R>
+{
+public:
+    TaskFuture() noexcept = default;
+    TaskFuture(std::future<R> &&future, ThreadPool *pool) noexcept
+        : std::future<R>(std::move(future)), pool_(pool) {}
+
+    decltype(auto) get();
+    void wait() const;
+
+private:
+    ThreadPool *pool_ = nullptr;
+};
+
 class ThreadPool
 {
 public:
+    // 该值影响 ThreadPool 的内存布局, 所有包含本头文件的编译单元须使用相同的 -mtune/-mcpu
+#ifdef __cpp_lib_hardware_interference_size
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+    static constexpr size_t CACHE_LINE_SIZE = std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+#endif
+
     // ================ 公共 API =====================
 
+    using Clock = std::chrono::steady_clock;
+
     ThreadPool();
+    // 所有内部分配 (任务队列, 线程槽位, 任务缓冲区, 亲和队列, 统计分片, 任务节点, future 共享状态) 均来自 resource
+    // 例外: std::thread 的内部状态, 以及首次使用时才创建的异步 I/O, epoll 与指标服务对象
+    // 调用者须保证 resource 的生命周期长于线程池及其返回的所有 future
+    // resource 须是线程安全的 (如 new_delete_resource, synchronized_pool_resource): 工作线程与提交者会并发地向它分配和释放,
+    // 线程池不会为这些调用加锁; monotonic_buffer_resource, unsynchronized_pool_resource 等不能直接传入
+    explicit ThreadPool(std::pmr::memory_resource *resource);
     ~ThreadPool();
 
     void setMode(PoolMode mode);
     void setPolicy(RejectionPolicy policy);
     void setTaskQueMaxThreshHold(int threshhold);
     void setThreadSizeThreshHold(int threshhold);
+    // 排队及执行中任务占用内存的上限 (字节), 0 表示不限; 超出时与队列满一样应用拒绝策略
+    void setTaskQueMaxBytes(size_t bytes);
+    void setSchedulePolicy(SchedulePolicy policy);
+    // 空闲策略: 队列为空时先自旋 spinCount 次, 再 yield yieldCount 次, 最后才阻塞等待
+    void setIdleStrategy(int spinCount, int yieldCount = 0);
+    // 延迟启动: start() 不创建线程, 提交任务时按需创建, 直到 initThreadSize 个
+    void setLazyStart(bool lazy);
+    // 批量取任务: 工作线程每次加锁最多取出 maxBatch 个任务放入自己的本地缓冲区 (1 表示不批量, 默认)
+    // 实际数量随排队任务数和空闲线程数自适应; 空闲线程会从其他线程的缓冲区窃取任务
+    void setTaskBatchSize(int maxBatch);
+    // 亲和任务的窃取阈值: 首选线程的本地队列超过该长度时其他线程才可窃取, 0 表示从不窃取 (默认 16)
+    void setAffinityStealThreshHold(int threshhold);
+    // 拓扑感知: start() 时从 sysfs 读取共享 L3 的 CPU 分组, 把工作线程按分组依次绑定到 CPU 上,
+    // 窃取时先在同一分组内查找, 跨分组时不取对方缓冲区中的最后一个任务 (默认关闭; 仅 Linux 绑核)
+    void setTopologyAware(bool enable);
+    // 任务节点及 future 共享状态所用的内存资源, 默认为线程池自带的分级空闲链表, 工作线程各有无锁的本地链表
+    // 调用者须保证 resource 的生命周期长于线程池及其返回的所有 future, 且 resource 须是线程安全的
+    void setTaskMemoryResource(std::pmr::memory_resource *resource);
+    // 阻塞任务专用线程池的线程数上限, 须在 start() 之前设置
+    void setBlockingThreadSizeThreshHold(int threshhold);
+    // 阻塞区域补偿线程数上限, 默认 0 (不补偿); start() 时按此额外预留线程槽位
+    void setBlockingCompensationThreshHold(int threshhold);
     void start(int initThreadSize = std::thread::hardware_concurrency());
     void shutdown();
 
@@ -45,144 +204,564 @@ public:
     int getIdleThreadCount()const;
     int getActiveThreadCount()const;
     size_t getTaskQueueSize();
+    size_t getExpiredTaskCount() const;
+    size_t getOutstandingTaskBytes() const;
+    // 汇总各线程的统计计数, 不获取 taskQueMtx_; 计数为 relaxed 原子量, 各项之间不保证是同一时刻的值
+    PoolStats getStats() const;
+    // 以 OpenMetrics 文本格式输出线程数, 队列深度, 任务计数与延迟直方图, 样本带 pool="poolName" 标签
+    std::string renderMetrics(const std::string &poolName = "default") const;
+#if defined(__linux__)
+    // 在 127.0.0.1:port 上启动一个专用线程提供 GET /metrics, port 为 0 时由系统分配; 返回实际端口, 失败时抛出异常
+    // 使用独立线程而不是工作线程, 线程池饱和时仍能抓取; shutdown() 时自动停止
+    int startMetricsServer(int port = 0, const std::string &poolName = "default");
+    void stopMetricsServer();
+#endif
 
     template <typename Func, typename... Args>
-    auto submitTask(Func &&func, Args &&...args) -> std::future<decltype(func(args...))>
+    auto submitTask(Func &&func, Args &&...args) -> TaskFuture<decltype(func(args...))>
     {
         return submitTaskWithPriority(0, std::forward<Func>(func), std::forward<Args>(args)...);
     }
 
+    // 提交会长时间阻塞 (磁盘/网络 I/O 等) 的任务: 在独立的 cached 模式 I/O 线程池中执行,
+    // 既不占用计算线程, 也不会让计算线程数膨胀; I/O 线程池在首次调用时创建
     template <typename Func, typename... Args>
-    auto submitTaskWithPriority(int priority, Func &&func, Args &&...args) -> std::future<decltype(func(args...))>
+    auto submitBlocking(Func &&func, Args &&...args) -> TaskFuture<decltype(func(args...))>
+    {
+        return blockingLane().submitTask(std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    // 工作线程即将进入阻塞区域时调用 (类似 Go 的 entersyscall): 若有排队任务且未超出
+    // setBlockingCompensationThreshHold() 的上限, 临时补充一个工作线程
+    // 在非工作线程中调用无效果; 可嵌套, 仅最外层生效
+    static void enterBlocking();
+    static void exitBlocking();
+
+    // 当前线程是否为本线程池的工作线程
+    bool isWorkerThread() const { return currentPool_ == this; }
+    // 当前工作线程在所属线程池中的下标, 取值 0..getMaxThreadCount()-1, 线程退出后其下标由新线程复用
+    // 非工作线程返回 -1
+    static int currentWorkerIndex() { return currentPool_ != nullptr ? workerIndex_ : -1; }
+    // 工作线程下标的上限 (线程槽位数), start() 之后有效
+    int getMaxThreadCount() const { return threadCapacity_; }
+    // 拓扑感知时 index 号工作线程所在的 L3 分组及其绑定的 CPU, 未开启时均为 -1
+    int getWorkerGroup(int index) const;
+    int getWorkerCpu(int index) const;
+    int getTopologyGroupCount() const { return (int)groupSlots_.size(); }
+    // 当前进程可用的 CPU 按共享 L3 分组, 读不到缓存信息时按物理封装分组; 非 Linux 平台为一个分组
+    static std::vector<std::vector<int>> readCacheTopology();
+
+    // 亲和提交: 按 std::hash<Key>(key) 选择首选工作线程, 任务进入该线程的本地队列并按提交顺序执行,
+    // 使同一分片的数据留在同一线程的缓存中; 仅当该队列超过窃取阈值时其他线程才会窃取
+    // 窃取阈值为 0 时同一 key 的任务在同一线程上串行执行, 任务内无需加锁
+    // 延迟启动或没有初始线程时退化为 submitTask()
+    template <typename Key, typename Func, typename... Args>
+    auto submitWithAffinity(const Key &key, Func &&func, Args &&...args) -> TaskFuture<decltype(func(args...))>
     {
         using RType = decltype(func(args...));
 
+        if (affinityQueueCount_ == 0)
+        {
+            return submitTask(std::forward<Func>(func), std::forward<Args>(args)...);
+        }
         if (!isPoolRunning_)
         {
             throw std::runtime_error("ThreadPool is shutting down, no new tasks accepted.");
         }
 
-        // auto task = std::make_shared<std::packaged_task<RType()>>(std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
         auto bound_func = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
-        auto packaged_task = std::packaged_task<RType()>(std::move(bound_func));
-        std::future<RType> result = packaged_task.get_future();
-        auto task_ptr = std::make_unique<ConcreteTask<RType>>(std::move(packaged_task));
+        auto *rawTask = makeTask<RType>(std::move(bound_func));
+        TaskPtr task_ptr(rawTask, TaskDeleter(taskResource_.get()));
+        TaskFuture<RType> result(rawTask->promise_.get_future(), this);
 
-        Thread *newThreadPtr = nullptr;
-        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        size_t index = std::hash<Key>{}(key) % (size_t)affinityQueueCount_;
+        size_t footprint = sizeof(*rawTask);
 
-        if (!notFull.wait_for(lock, std::chrono::seconds(1),
-                              [&]() -> bool
-                              { return taskQue_.size() < (size_t)taskQueMaxThreshHold_; }))
+        // 与共享队列相同的准入、拒绝策略与字节预算; 亲和队列中的任务同样计入队列上限
+        std::unique_lock<std::mutex> lock(taskQueMtx_, std::defer_lock);
+        lockTaskQueue(lock);
+        if (!waitForSpace(lock, footprint))
         {
-            switch (rejectionPolicy_)
-            {
-            case RejectionPolicy::Abort:
-                std::cerr << "submit task timeout" << std::endl;
-                throw std::runtime_error("Task queue is full...");
+            rejectTask(lock, task_ptr, Clock::time_point::max());
+            return result;
+        }
+        bool needNewThread = pushAffinityTask((int)index, myTask(std::move(task_ptr), 0, Clock::time_point::max(), footprint));
+        lock.unlock();
+        if (needNewThread)
+        {
+            spawnThread();
+        }
+        return result;
+    }
+
+    // 在本线程池的工作线程中调用时, 执行队列中的任务直到 ready(timeout) 返回 true; 否则直接等待
+    // ready(d) 最多等待 d 并返回结果是否已就绪
+    void helpWhileWaiting(const std::function<bool(std::chrono::microseconds)> &ready);
 
-            case RejectionPolicy::Discard:
-                std::cerr << "Task discarded" << std::endl;
-                return result; 
+    // 在作用域内标记阻塞区域
+    class BlockingRegion
+    {
+    public:
+        BlockingRegion() { enterBlocking(); }
+        ~BlockingRegion() { exitBlocking(); }
+        BlockingRegion(const BlockingRegion &) = delete;
+        BlockingRegion &operator=(const BlockingRegion &) = delete;
+    };
 
-            case RejectionPolicy::CallerRuns:
-                std::cerr << "Task queue full, running in caller thread" << std::endl;
-                lock.unlock();
+    template <typename Func, typename... Args>
+    auto submitTaskWithPriority(int priority, Func &&func, Args &&...args) -> TaskFuture<decltype(func(args...))>
+    {
+        TaskOptions options;
+        options.priority = priority;
+        return submitTaskWithOptions(options, std::forward<Func>(func), std::forward<Args>(args)...);
+    }
 
-                task_ptr->execute();
-                return result;
-            }
+    // 带截止时间的任务: 若取出时已超过 deadline 则直接丢弃, future 抛出 TaskExpiredError
+    template <typename Func, typename... Args>
+    auto submitTaskWithDeadline(Clock::time_point deadline, Func &&func, Args &&...args) -> TaskFuture<decltype(func(args...))>
+    {
+        TaskOptions options;
+        options.deadline = deadline;
+        return submitTaskWithOptions(options, std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    template <typename Func, typename... Args>
+    auto submitTaskWithPriorityAndDeadline(int priority, Clock::time_point deadline, Func &&func, Args &&...args) -> TaskFuture<decltype(func(args...))>
+    {
+        TaskOptions options;
+        options.priority = priority;
+        options.deadline = deadline;
+        return submitTaskWithOptions(options, std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    template <typename Func, typename... Args>
+    auto submitTaskWithOptions(const TaskOptions &options, Func &&func, Args &&...args) -> TaskFuture<decltype(func(args...))>
+    {
+        using RType = decltype(func(args...));
+
+        if (!isPoolRunning_)
+        {
+            throw std::runtime_error("ThreadPool is shutting down, no new tasks accepted.");
         }
 
-        // 添加带权重的任务
-        // auto taskFunc = std::make_shared<std::function<void()>>([task]() { (*task)(); });
-        // taskQue_.emplace(taskFunc, priority);
-        taskQue_.emplace(std::move(task_ptr), priority);
-        notEmpty.notify_one();
+        // 任务节点与 future 的共享状态都从 taskResource_ 分配, 稳态下可复用已释放的内存块
+        auto bound_func = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
+        auto *rawTask = makeTask<RType>(std::move(bound_func));
+        TaskPtr task_ptr(rawTask, TaskDeleter(taskResource_.get()));
+        TaskFuture<RType> result(rawTask->promise_.get_future(), this);
+
+        // 未声明占用时按任务节点大小估算 (包含按值捕获的参数)
+        size_t footprint = options.footprint > 0 ? options.footprint : sizeof(*rawTask);
+        Clock::time_point deadline = options.deadline;
 
-        if (poolMode_ == PoolMode::MODE_CACHED &&
-            taskQue_.size() > (size_t)idleThreadSize_ &&
-            curThreadSize_ < threadSizeThreshHold_)
+        std::unique_lock<std::mutex> lock(taskQueMtx_, std::defer_lock);
+        lockTaskQueue(lock);
+
+        if (options.executor < 0 || (size_t)options.executor >= flows_.size())
         {
-            auto ptr = std::make_unique<Thread>(
-                std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-            int threadId = ptr->getId();
-            newThreadPtr = ptr.get();
-            threads_.emplace(threadId, std::move(ptr));
-            curThreadSize_++;
+            throw std::invalid_argument("Unknown executor id");
         }
 
-        lock.unlock();
+        if (!waitForSpace(lock, footprint))
+        {
+            rejectTask(lock, task_ptr, deadline);
+            return result;
+        }
 
-        if (newThreadPtr != nullptr)
+        // 等待期间线程池可能已被关闭, 此时入队的任务将不会再被执行
+        if (!isPoolRunning_)
         {
-            newThreadPtr->start();
+            throw std::runtime_error("ThreadPool is shutting down, no new tasks accepted.");
         }
 
+        // 添加带权重的任务
+        TaskFlow *flow = options.tenant != 0 ? findTenantFlow(options.tenant) : &flows_[options.executor];
+        enqueueTask(lock, myTask(std::move(task_ptr), options.priority, deadline, footprint, flow));
         return result;
     }
+    // --- Executor: 共享线程池工作线程的逻辑执行器 ---
+    // 每个执行器有独立的任务队列、权重和并发上限, 工作线程按权重在各执行器之间公平调度
+    class Executor
+    {
+    public:
+        template <typename Func, typename... Args>
+        auto submitTask(Func &&func, Args &&...args) -> TaskFuture<decltype(func(args...))>
+        {
+            return submitTaskWithOptions(TaskOptions{}, std::forward<Func>(func), std::forward<Args>(args)...);
+        }
+
+        template <typename Func, typename... Args>
+        auto submitTaskWithPriority(int priority, Func &&func, Args &&...args) -> TaskFuture<decltype(func(args...))>
+        {
+            TaskOptions options;
+            options.priority = priority;
+            return submitTaskWithOptions(options, std::forward<Func>(func), std::forward<Args>(args)...);
+        }
+
+        template <typename Func, typename... Args>
+        auto submitTaskWithOptions(TaskOptions options, Func &&func, Args &&...args) -> TaskFuture<decltype(func(args...))>
+        {
+            options.executor = id_;
+            return pool_->submitTaskWithOptions(options, std::forward<Func>(func), std::forward<Args>(args)...);
+        }
+
+        int getId() const { return id_; }
+        std::string getName() const;
+        size_t getTaskQueueSize() const;
+        int getRunningTaskCount() const;
+        TaskFlowStats getStats() const;
+
+    private:
+        friend class ThreadPool;
+        Executor(ThreadPool *pool, int id) : pool_(pool), id_(id) {}
+
+        ThreadPool *pool_;
+        int id_;
+    };
+
+    // 创建执行器; weight 为调度权重, maxConcurrency 为同时执行的任务数上限 (0 表示不限)
+    Executor createExecutor(const std::string &name, int weight = 1, int maxConcurrency = 0);
+
+private:
+    struct StrandState;
+
+public:
+    // 串行执行器: 投递到同一 Strand 的任务按投递顺序执行, 且不会并发执行
+    // 有待执行任务时最多占用一个工作线程, 空闲时不占用任何线程; 投递路径无锁, 仅在 Strand 从空闲变为忙碌时入队一次
+    // 可复制, 副本共享同一个队列; 线程池须比 Strand 及其任务活得更久
+    class Strand
+    {
+    public:
+        template <typename Func, typename... Args>
+        auto post(Func &&func, Args &&...args) -> TaskFuture<decltype(func(args...))>
+        {
+            using RType = decltype(func(args...));
+
+            if (!pool_->isPoolRunning_)
+            {
+                throw std::runtime_error("ThreadPool is shutting down, no new tasks accepted.");
+            }
+
+            auto bound_func = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
+            auto *rawTask = pool_->makeTask<RType>(std::move(bound_func));
+            TaskPtr task_ptr(rawTask, TaskDeleter(pool_->taskResource_.get()));
+            TaskFuture<RType> result(rawTask->promise_.get_future(), pool_);
+
+            pool_->postToStrand(state_, std::move(task_ptr));
+            return result;
+        }
+
+        // 已投递但尚未执行完的任务数
+        size_t getPendingTaskCount() const;
+
+    private:
+        friend class ThreadPool;
+        Strand(ThreadPool *pool, std::shared_ptr<StrandState> state) : pool_(pool), state_(std::move(state)) {}
+
+        ThreadPool *pool_;
+        std::shared_ptr<StrandState> state_;
+    };
+
+    Strand createStrand();
+
+    // 租户: 通过 TaskOptions::tenant 提交, 每个租户有独立队列, 按权重做差额轮转 (DRR) 调度
+    // 未设置过的租户权重为 1, 不限并发
+    void setTenantWeight(uint64_t tenant, int weight, int maxConcurrency = 0);
+    TaskFlowStats getTenantStats(uint64_t tenant);
+
+    // 执行策略: 传给 parallel.h 中的并行算法, 在本线程池上执行
+    // grainSize 为每块的元素数, 0 表示自动 (约为线程数的 4 倍块)
+    struct ParallelPolicy
+    {
+        ThreadPool *pool;
+        size_t grainSize;
+    };
+    ParallelPolicy par(size_t grainSize = 0) { return ParallelPolicy{this, grainSize}; }
+
+    // fork-join: 把 [begin, end) 切成大小为 grainSize 的块, 对每块调用 body(lo, hi), 所有块完成后返回
+    // 调用者线程与被唤醒的工作线程从同一个计数器领取块; 只等待已被领取的块, 在工作线程中调用也不会死锁
+    // body 抛出的第一个异常在返回前重新抛出, 之后尚未开始的块被跳过
+    template <typename Body>
+    void parallelFor(size_t begin, size_t end, Body &&body, size_t grainSize = 0)
+    {
+        using State = ForkJoinState<std::remove_reference_t<Body>>;
+        if (begin >= end)
+        {
+            return;
+        }
+        size_t count = end - begin;
+        size_t workers = (size_t)std::max(1, getCurrentThreadCount());
+        if (grainSize == 0)
+        {
+            size_t chunksWanted = 4 * (workers + 1);
+            grainSize = (count + chunksWanted - 1) / chunksWanted;
+        }
+        size_t chunks = (count + grainSize - 1) / grainSize;
+        if (chunks == 1 || !isPoolRunning_)
+        {
+            body(begin, end);
+            return;
+        }
+
+        auto state = std::make_shared<State>(&body, begin, end, grainSize, chunks);
+        size_t helpers = std::min(chunks - 1, workers);
+        for (size_t i = 0; i < helpers; i++)
+        {
+            // 不等待队列空位: 线程池正在关闭或队列已满时剩余的块由调用者完成
+            auto *rawTask = makeTask<void>([state]
+                                           { state->run(); });
+            if (!tryEnqueueTask(TaskPtr(rawTask, TaskDeleter(taskResource_.get())), sizeof(*rawTask)))
+            {
+                break;
+            }
+        }
+        state->run();
+
+        {
+            std::unique_lock<std::mutex> lock(state->mtx);
+            state->done.wait(lock, [&]
+                             { return state->doneChunks.load(std::memory_order_acquire) == chunks; });
+        }
+        if (state->error)
+        {
+            std::rethrow_exception(state->error);
+        }
+    }
+
+#if defined(__linux__)
+    // 异步文件 I/O: 通过线程池持有的 io_uring 实例提交, 等待期间不占用任何线程
+    // 结果为读写的字节数, 出错时为 -errno; 内核不支持 io_uring 时退化为在 I/O 线程池中执行 pread/pwrite
+    std::future<long> readAsync(int fd, void *buf, size_t len, int64_t offset);
+    std::future<long> writeAsync(int fd, const void *buf, size_t len, int64_t offset);
+    // 完成后 callback(result) 作为普通任务提交到线程池执行
+    void readAsync(int fd, void *buf, size_t len, int64_t offset, std::function<void(long)> callback);
+    void writeAsync(int fd, const void *buf, size_t len, int64_t offset, std::function<void(long)> callback);
+    // 异步 I/O 是否由 io_uring 完成 (首次调用时初始化 io_uring)
+    bool isIoUringEnabled();
+
+    // 事件循环: 任务队列为空时, 空闲的工作线程轮流作为 leader 在 epoll 上等待 (leader/follower),
+    // 就绪事件直接在该线程上调用 handler(events), 不经过任务队列; 同一 fd 的 handler 不会并发执行
+    // 首次调用时创建 epoll 实例; 至少需要一个工作线程
+    void addFd(int fd, uint32_t events, std::function<void(uint32_t)> handler);
+    void modifyFd(int fd, uint32_t events);
+    void removeFd(int fd);
+#endif
 
     ThreadPool(const ThreadPool &) = delete;
     ThreadPool &operator=(const ThreadPool &) = delete;
 
 private:
+    // 仅供基准与测试访问内部开关, 由 bench.cpp / test.cpp 各自定义, 不属于公开接口
+    friend struct ThreadPoolBenchAccess;
+    // 总是通知: 入队/出队时不检查等待者数量, 每次都调用 notify_one (即未统计等待者时的旧行为), 仅用于基准对比
+    void setAlwaysNotify(bool always);
+
     // ===============================================
 
-    // --- Thread 类 ---
-    class Thread
+    // --- 独占一条缓存行的计数器分片 ---
+    struct alignas(CACHE_LINE_SIZE) CounterShard
+    {
+        std::atomic_int value{0};
+    };
+    static constexpr int COUNTER_SHARDS = 16;
+
+    // --- Thread 类: 线程槽位, 每个槽位独占缓存行 ---
+    class alignas(CACHE_LINE_SIZE) Thread
     {
     public:
         using ThreadFunc = std::function<void(int)>;
-        Thread(ThreadFunc func);
-        ~Thread() = default;
-        void start();
+        Thread() = default;
+        ~Thread(); // join 尚未结束的线程
+        void start(ThreadFunc func, int threadId);
+        void join();
         int getId() const;
 
+        std::atomic_int nextFreeSlot_{-1}; // 空闲槽位链表中的下一个槽位
+
     private:
-        ThreadFunc func_;
-        static std::atomic_int generateId_;
-        int threadId_; // 自定义线程id以便回收
+        std::thread thread_;
+        int threadId_ = -1; // 线程id即槽位下标
+    };
+
+    // --- 从 memory_resource 分配的定长数组 (线程槽位, 任务缓冲区, 亲和队列, 统计分片) ---
+    // 删除器逐个析构后归还给分配它的资源
+    template <typename T>
+    struct ResourceArrayDeleter
+    {
+        std::pmr::memory_resource *resource;
+        size_t count;
+        ResourceArrayDeleter() : resource(nullptr), count(0) {}
+        ResourceArrayDeleter(std::pmr::memory_resource *r, size_t c) : resource(r), count(c) {}
+        void operator()(T *items) const
+        {
+            for (size_t i = count; i > 0; i--)
+            {
+                items[i - 1].~T();
+            }
+            resource->deallocate(items, sizeof(T) * count, alignof(T));
+        }
     };
+    template <typename T>
+    using ResourceArray = std::unique_ptr<T[], ResourceArrayDeleter<T>>;
+
+    // 从 resource 分配 count 个元素, 每个元素以 args 构造
+    template <typename T, typename... Args>
+    static ResourceArray<T> makeResourceArray(std::pmr::memory_resource *resource, size_t count, const Args &...args)
+    {
+        T *items = static_cast<T *>(resource->allocate(sizeof(T) * count, alignof(T)));
+        size_t constructed = 0;
+        try
+        {
+            for (; constructed < count; constructed++)
+            {
+                new (&items[constructed]) T(args...);
+            }
+        }
+        catch (...)
+        {
+            ResourceArrayDeleter<T>(resource, constructed)(items);
+            throw;
+        }
+        return ResourceArray<T>(items, ResourceArrayDeleter<T>(resource, count));
+    }
 
     // --- ITask 接口 ---
     struct ITask
     {
         virtual ~ITask() = default;
         virtual void execute() = 0;
+        virtual void expire() = 0;
+        // 析构自身并将内存归还给分配它的 memory_resource
+        virtual void destroy(std::pmr::memory_resource *resource) = 0;
     };
 
-    // --- ConcreteTask 实现 ---
-    template <typename R>
+    struct TaskDeleter
+    {
+        std::pmr::memory_resource *resource;
+        TaskDeleter() : resource(nullptr) {}
+        explicit TaskDeleter(std::pmr::memory_resource *r) : resource(r) {}
+        void operator()(ITask *task) const
+        {
+            task->destroy(resource);
+        }
+    };
+    using TaskPtr = std::unique_ptr<ITask, TaskDeleter>;
+
+    // --- future 共享状态的分配器: 共享持有内存资源, future 可以安全地晚于线程池销毁 ---
+    template <typename T>
+    struct TaskAllocator
+    {
+        using value_type = T;
+        std::shared_ptr<std::pmr::memory_resource> resource_;
+
+        explicit TaskAllocator(std::shared_ptr<std::pmr::memory_resource> resource)
+            : resource_(std::move(resource)) {}
+        template <typename U>
+        TaskAllocator(const TaskAllocator<U> &other) : resource_(other.resource_) {}
+
+        T *allocate(size_t n)
+        {
+            return static_cast<T *>(resource_->allocate(n * sizeof(T), alignof(T)));
+        }
+        void deallocate(T *p, size_t n)
+        {
+            resource_->deallocate(p, n * sizeof(T), alignof(T));
+        }
+        template <typename U>
+        bool operator==(const TaskAllocator<U> &other) const { return resource_ == other.resource_; }
+        template <typename U>
+        bool operator!=(const TaskAllocator<U> &other) const { return resource_ != other.resource_; }
+    };
+
+    // --- ConcreteTask 实现: 可调用对象直接存放在任务节点中 ---
+    template <typename R, typename F>
     class ConcreteTask : public ITask
     {
     public:
-        std::packaged_task<R()> task_;
-        ConcreteTask(std::packaged_task<R()> &&task) : task_(std::move(task)) {}
+        F func_;
+        std::promise<R> promise_;
+
+        ConcreteTask(F &&func, const TaskAllocator<char> &alloc)
+            : func_(std::move(func)), promise_(std::allocator_arg, alloc) {}
+
         void execute() override
         {
-            task_();
+            try
+            {
+                if constexpr (std::is_void_v<R>)
+                {
+                    func_();
+                    promise_.set_value();
+                }
+                else
+                {
+                    promise_.set_value(func_());
+                }
+            }
+            catch (...)
+            {
+                promise_.set_exception(std::current_exception());
+            }
+        }
+        void expire() override
+        {
+            // 过期的任务不调用用户函数, 而是让 future 抛出 TaskExpiredError
+            promise_.set_exception(std::make_exception_ptr(TaskExpiredError()));
+        }
+        void destroy(std::pmr::memory_resource *resource) override
+        {
+            this->~ConcreteTask();
+            resource->deallocate(this, sizeof(ConcreteTask), alignof(ConcreteTask));
         }
     };
 
+    // 从 taskResource_ 分配并构造任务节点
+    template <typename R, typename F>
+    ConcreteTask<R, F> *makeTask(F &&func)
+    {
+        using TaskType = ConcreteTask<R, F>;
+        void *mem = taskResource_->allocate(sizeof(TaskType), alignof(TaskType));
+        try
+        {
+            return new (mem) TaskType(std::move(func), TaskAllocator<char>(taskResource_));
+        }
+        catch (...)
+        {
+            taskResource_->deallocate(mem, sizeof(TaskType), alignof(TaskType));
+            throw;
+        }
+    }
+
+    struct TaskFlow;
+
     // --- myTask 包装器  ---
     class myTask
     {
     public:
         int weight_; // 任务权重,权重越大优先级越高
-        std::unique_ptr<ITask> task;
+        Clock::time_point deadline_ = Clock::time_point::max(); // 截止时间, max 表示不限
+        size_t footprint_ = 0;                                  // 计入字节预算的内存占用
+        TaskFlow *flow_ = nullptr;                              // 所属执行器
+        Clock::time_point enqueued_;                            // 入队时间, 仅在开启统计时记录
+        TaskPtr task;
 
         myTask() = default;
         ~myTask() = default;
 
-        myTask(std::unique_ptr<ITask> t, int w = 0)
-            : weight_(w), task(std::move(t)) {}
+        myTask(TaskPtr t, int w = 0, Clock::time_point d = Clock::time_point::max(), size_t f = 0, TaskFlow *flow = nullptr)
+            : weight_(w), deadline_(d), footprint_(f), flow_(flow), task(std::move(t)) {}
 
         myTask(myTask &&other) noexcept
-            : weight_(other.weight_), task(std::move(other.task)) {}
+            : weight_(other.weight_), deadline_(other.deadline_), footprint_(other.footprint_),
+              flow_(other.flow_), enqueued_(other.enqueued_), task(std::move(other.task)) {}
 
         myTask &operator=(myTask &&other) noexcept
         {
             weight_ = other.weight_;
+            deadline_ = other.deadline_;
+            footprint_ = other.footprint_;
+            flow_ = other.flow_;
+            enqueued_ = other.enqueued_;
             task = std::move(other.task);
             return *this;
         }
@@ -190,10 +769,192 @@ private:
         {
             return weight_ < a.weight_; // 权重越大优先级越高
         }
+        bool isExpired() const
+        {
+            return deadline_ != Clock::time_point::max() && deadline_ < Clock::now();
+        }
         myTask(const myTask &) = delete;
         myTask &operator=(const myTask &) = delete;
     };
 
+    // --- 任务队列比较器: 根据调度策略决定出队顺序 ---
+    struct TaskCompare
+    {
+        SchedulePolicy policy = SchedulePolicy::Priority;
+        bool operator()(const myTask &a, const myTask &b) const
+        {
+            if (policy == SchedulePolicy::EDF && a.deadline_ != b.deadline_)
+            {
+                return a.deadline_ > b.deadline_; // 截止时间越早越先执行
+            }
+            return a < b;
+        }
+    };
+    using TaskQueue = std::priority_queue<myTask, std::pmr::vector<myTask>, TaskCompare>;
+
+    // --- ForkJoinState: 一次 parallelFor 的共享状态, 由调用者与所有辅助任务共同持有 ---
+    template <typename Body>
+    struct ForkJoinState
+    {
+        ForkJoinState(Body *b, size_t first, size_t last, size_t grain, size_t chunkCount)
+            : body(b), begin(first), end(last), grainSize(grain), chunks(chunkCount) {}
+
+        // 领取并执行块, 直到没有剩余的块; 块全部领完后才开始的辅助任务不会访问 body
+        void run()
+        {
+            size_t chunk;
+            while ((chunk = nextChunk.fetch_add(1, std::memory_order_relaxed)) < chunks)
+            {
+                if (!failed.load(std::memory_order_relaxed))
+                {
+                    size_t lo = begin + chunk * grainSize;
+                    size_t hi = std::min(end, lo + grainSize);
+                    try
+                    {
+                        (*body)(lo, hi);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> guard(mtx);
+                        if (!error)
+                        {
+                            error = std::current_exception();
+                        }
+                        failed.store(true, std::memory_order_relaxed);
+                    }
+                }
+                if (doneChunks.fetch_add(1, std::memory_order_acq_rel) + 1 == chunks)
+                {
+                    std::lock_guard<std::mutex> guard(mtx);
+                    done.notify_all();
+                }
+            }
+        }
+
+        Body *body;
+        size_t begin;
+        size_t end;
+        size_t grainSize;
+        size_t chunks;
+        std::atomic<size_t> nextChunk{0};
+        std::atomic<size_t> doneChunks{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex mtx;
+        std::condition_variable done;
+    };
+
+    // --- TaskBatch: 工作线程批量取出的任务, 所有者从头部取, 窃取者从尾部取 ---
+    static constexpr int MAX_TASK_BATCH = 32;
+    struct alignas(CACHE_LINE_SIZE) TaskBatch
+    {
+        std::mutex mtx;
+        std::atomic_int size{0}; // 无锁快速判断是否为空
+        int head = 0;
+        std::array<myTask, MAX_TASK_BATCH> tasks;
+    };
+
+    // --- AffinityQueue: 初始线程各自的亲和任务队列, 所有者与窃取者都从头部取 ---
+    struct alignas(CACHE_LINE_SIZE) AffinityQueue
+    {
+        explicit AffinityQueue(std::pmr::memory_resource *resource)
+            : tasks(std::pmr::polymorphic_allocator<myTask>(resource)) {}
+
+        std::mutex mtx;
+        std::atomic_int size{0}; // 无锁快速判断是否为空或过载
+        std::pmr::deque<myTask> tasks;
+        bool ownerWaiting = false; // 所有者阻塞在 notEmpty 或 epoll 上, 受 taskQueMtx_ 保护
+    };
+
+    // --- StrandState: Strand 的无锁多生产者单消费者队列 (头部为哨兵节点) ---
+    // 投递者把节点交换到 tail 后再链接, pending 从 0 变为 1 的投递者负责调度一次 drainStrand
+    // 同一时刻只有一个 drainStrand 在执行, 它独占 head
+    struct StrandNode
+    {
+        std::atomic<StrandNode *> next{nullptr};
+        myTask task; // 经 runTask 执行, 与普通任务一样做过期检查并计入统计
+    };
+    struct StrandState
+    {
+        explicit StrandState(std::pmr::memory_resource *r) : resource(r), head(&stub), tail(&stub) {}
+        ~StrandState(); // 销毁未执行的任务, 其 future 抛出 broken_promise
+        void freeNode(StrandNode *node);
+
+        std::pmr::memory_resource *resource; // 节点的内存资源 (即 taskResource_)
+        StrandNode *head;
+        std::atomic<StrandNode *> tail;
+        std::atomic<size_t> pending{0};
+        StrandNode stub;
+    };
+
+    // --- StatsShard: 统计计数分片, 每个工作线程一个, 非工作线程按线程散列到额外的分片 ---
+    struct alignas(CACHE_LINE_SIZE) StatsShard
+    {
+        std::atomic<uint64_t> submitted{0};
+        std::atomic<uint64_t> completed{0};
+        std::atomic<uint64_t> rejected{0};
+        std::atomic<uint64_t> callerRuns{0};
+        std::atomic<uint64_t> discarded{0};
+        std::atomic<uint64_t> threadsSpawned{0};
+        std::atomic<uint64_t> threadsReaped{0};
+        std::atomic<uint64_t> notifies{0};
+        std::atomic<uint64_t> idleNanos{0};
+        std::atomic<uint64_t> lockWaitNanos{0};
+        std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKETS> queueWaitBuckets{};
+        std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKETS> runTimeBuckets{};
+        std::atomic<uint64_t> queueWaitNanos{0};
+        std::atomic<uint64_t> runTimeNanos{0};
+    };
+
+    // --- StatsSlot: 线程槽位的统计分片指针, 分片在槽位首次启动线程时从 resource 分配, 槽位数组析构时释放 ---
+    struct StatsSlot
+    {
+        explicit StatsSlot(std::pmr::memory_resource *r) : resource(r) {}
+        ~StatsSlot()
+        {
+            if (StatsShard *s = shard.load(std::memory_order_relaxed))
+            {
+                s->~StatsShard();
+                resource->deallocate(s, sizeof(StatsShard), alignof(StatsShard));
+            }
+        }
+        StatsSlot(const StatsSlot &) = delete;
+        StatsSlot &operator=(const StatsSlot &) = delete;
+
+        std::pmr::memory_resource *resource;
+        std::atomic<StatsShard *> shard{nullptr}; // 只从空指针以 CAS 设置一次, getStats() 在锁外读取
+    };
+
+    // --- TaskFlow: 执行器或租户的任务队列及其调度状态, 除计数器外均受 taskQueMtx_ 保护 ---
+    struct TaskFlow
+    {
+        TaskFlow(std::string_view n, int w, int maxConc, SchedulePolicy policy, std::pmr::memory_resource *resource);
+
+        std::pmr::string name; // 执行器名称, 租户队列为空
+        TaskQueue queue;
+        int weight;              // DRR 每轮可取出的任务数
+        int maxConcurrency;      // 0 表示不限
+        std::atomic_int running; // 正在执行的任务数, 在锁内增加, 不限并发时在锁外减少
+        int deficit;             // 本轮剩余可取出的任务数
+        bool active;             // 是否在活跃链表中
+        TaskFlow *nextActive;    // 活跃链表中的下一个
+
+        std::atomic<uint64_t> submittedTasks{0};
+        std::atomic<uint64_t> completedTasks{0};
+
+        bool runnable() const
+        {
+            return !queue.empty() && (maxConcurrency == 0 || running < maxConcurrency);
+        }
+    };
+    static constexpr size_t TENANT_SWEEP_MIN = 64;
+    // 已回收租户的累计计数, 租户再次出现时移回新建的队列, 保证 getTenantStats 单调递增
+    struct TenantCounters
+    {
+        uint64_t submitted;
+        uint64_t completed;
+    };
+
 private:
     // ============= ThreadPool 成员 =================
 
@@ -201,26 +962,359 @@ private:
     void threadFunc(int threadid);
     // 检查线程池运行状态
     bool checkRunningState() const;
+    // 释放锁后自旋等待新任务, 返回前重新加锁
+    // index 为调用线程的槽位下标, 自己的亲和队列非空时也停止自旋
+    void spinWait(std::unique_lock<std::mutex> &lock, int index);
+    // 字节预算是否还能容纳 footprint; 没有未完成的任务时总是允许, 避免超大任务永远无法提交
+    bool hasByteBudget(size_t footprint) const;
+    // 计入队列上限的任务数: 共享队列, 各线程缓冲区与亲和队列中尚未执行的任务
+    size_t boundedTaskCount() const
+    {
+        return queuedTaskSize_ + batchedTaskSize_.load() + affinityTaskSize_.load();
+    }
+    // 准入检查: boundedTaskCount() 达到上限或超出字节预算时最多等待 1 秒, 返回是否有空位
+    // 调用者须持有 lock
+    bool waitForSpace(std::unique_lock<std::mutex> &lock, size_t footprint);
+    // 没有空位时按拒绝策略处理任务: Abort 抛出异常, Discard 丢弃, CallerRuns 释放 lock 后在调用者线程执行
+    void rejectTask(std::unique_lock<std::mutex> &lock, TaskPtr &task, Clock::time_point deadline);
+    // 在锁外从亲和队列取出任务后调用: 有提交者等待空位时唤醒它们
+    void notifySpaceFreed();
+    // 从队列取出一个任务并在当前线程执行, 队列中没有可执行的任务时返回 false
+    bool runQueuedTask();
+    // 按排队任务数与空闲线程数再取出若干任务放入 index 号线程的缓冲区, 调用者须持有 taskQueMtx_
+    void fillTaskBatch(int index);
+    // 从自己的缓冲区头部取任务
+    bool takeBatchedTask(int index, myTask &task);
+    // 从其他线程的缓冲区尾部窃取任务
+    bool stealBatchedTask(int index, myTask &task);
+    // 缓冲区中多于 minCount 个任务时从 victim 号缓冲区尾部窃取一个
+    bool stealBatchedFrom(int victim, myTask &task, int minCount);
+    // 亲和任务入队并唤醒其所有者, 过载时唤醒一个窃取者; 调用者须持有 taskQueMtx_ 并已通过准入检查
+    // 返回是否需要创建线程来窃取积压的任务, 调用者释放锁后调用 spawnThread()
+    bool pushAffinityTask(int index, myTask &&task);
+    // cached 模式下积压任务多于空闲线程且未达到线程上限时预留一个线程名额, 返回是否预留成功
+    // 调用者须持有 taskQueMtx_, 释放锁后调用 spawnThread()
+    bool reserveThread(size_t backlog);
+    // 从自己的亲和队列取任务
+    bool takeAffinityTask(int index, myTask &task);
+    // 从过载的其他亲和队列窃取任务
+    bool stealAffinityTask(int index, myTask &task);
+    bool stealAffinityFrom(int victim, myTask &task);
+    bool hasAffinityTask(int index) const;
+    // 标记 index 号线程是否阻塞等待, 调用者须持有 taskQueMtx_
+    void setOwnerWaiting(int index, bool waiting);
+    // Strand: 节点入队, 必要时调度 drainStrand; 调度失败时丢弃已链接的任务并重新抛出异常
+    void postToStrand(const std::shared_ptr<StrandState> &state, TaskPtr task);
+    // 把 drainStrand 作为普通任务入队; 不受队列容量与拒绝策略限制, 因为其中的任务已被接受
+    void scheduleStrand(std::shared_ptr<StrandState> state);
+    // 按顺序执行 Strand 中的任务, 每次最多 STRAND_MAX_BATCH 个, 之后重新入队以免饿死其他任务
+    void drainStrand(const std::shared_ptr<StrandState> &state);
+    // 取出 head 之后的下一个任务, 调用者须是当前唯一的消费者且 pending > 0
+    static myTask popStrandTask(StrandState &state);
+    // 调度失败时销毁所有已链接的任务 (future 抛出 broken_promise), 直到 pending 归零, Strand 回到空闲状态
+    void discardStrand(StrandState &state);
+    // 统计: 关闭 THREADPOOL_STATS 时均为空函数, 编译后没有任何开销
+#if THREADPOOL_STATS
+    // 当前线程写入的统计分片: 工作线程用自己槽位的分片, 非工作线程 (提交者) 按线程散列到外部分片, 散列值按线程缓存
+    // 槽位分片分配失败时工作线程同样退回外部分片
+    StatsShard &statsShard()
+    {
+        if (isWorkerThread())
+        {
+            if (StatsShard *shard = statsSlots_[workerIndex_].shard.load(std::memory_order_relaxed))
+            {
+                return *shard;
+            }
+        }
+        static thread_local size_t externalShard = std::hash<std::thread::id>{}(std::this_thread::get_id()) % COUNTER_SHARDS;
+        return externalStats_[externalShard];
+    }
+    // 为槽位 index 分配统计分片 (若尚未分配), 不加锁, 以 CAS 安装到槽位上
+    void allocStatsShard(int index);
+#endif
+    using StatField = std::atomic<uint64_t> StatsShard::*;
+    void countStat(StatField field, uint64_t value = 1)
+    {
+#if THREADPOOL_STATS
+        (statsShard().*field).fetch_add(value, std::memory_order_relaxed);
+#else
+        (void)field;
+        (void)value;
+#endif
+    }
+    // 发出通知并计入统计
+    void notifyOne(std::condition_variable &cv)
+    {
+        countStat(&StatsShard::notifies);
+        cv.notify_one();
+    }
+    void notifyAll(std::condition_variable &cv)
+    {
+        countStat(&StatsShard::notifies);
+        cv.notify_all();
+    }
+    // 入队/出队握手时是否需要通知 waiters 个等待者 (总是通知时忽略等待者数量)
+    bool shouldNotify(int waiters) const
+    {
+        return waiters > 0 || alwaysNotify_;
+    }
+    // 统计计时的起点, 关闭统计时为默认值
+    static Clock::time_point statsNow()
+    {
+#if THREADPOOL_STATS
+        return Clock::now();
+#else
+        return Clock::time_point();
+#endif
+    }
+    // 把 since 至今的时间计入 field, since 为默认值时忽略
+    void countElapsed(StatField field, Clock::time_point since)
+    {
+        if (since != Clock::time_point())
+        {
+            countStat(field, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - since).count());
+        }
+    }
+    // 把一次延迟计入直方图
+    void countLatency(std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKETS> StatsShard::*buckets,
+                      StatField sum, Clock::duration latency);
+    // 获取 taskQueMtx_, 需要等待时把等待时间计入统计
+    void lockTaskQueue(std::unique_lock<std::mutex> &lock)
+    {
+        if (THREADPOOL_STATS && lock.try_lock())
+        {
+            return;
+        }
+        Clock::time_point begin = statsNow();
+        lock.lock();
+        countElapsed(&StatsShard::lockWaitNanos, begin);
+    }
+    // 执行一个已出队的任务, 并更新统计与执行器状态
+    void runTask(myTask &aTask);
 
-    std::unordered_map<int, std::unique_ptr<Thread>> threads_;
+    // 当前允许的线程数: cached 模式为 threadSizeThreshHold_, 否则为 initThreadSize_,
+    // 再加上处于阻塞区域的线程数 (不超过补偿上限); 调用者须持有 taskQueMtx_
+    int threadLimit() const;
+    // submitBlocking() 的目标线程池: 运行中首次调用时创建 I/O 线程池, 未运行或本身即为 I/O 线程池时返回 *this
+    ThreadPool &blockingLane();
 
-    int initThreadSize_;
-    int threadSizeThreshHold_;       // 线程数量上限
-    std::atomic_int curThreadSize_;  // 当前线程数量
-    std::atomic_int idleThreadSize_; // 空闲线程数量
+    // 任务入队/出队, 调用者须持有 taskQueMtx_
+    void pushTask(myTask &&task);
+    // 已通过准入检查的任务入队: 计入字节预算, 按需唤醒或创建线程, 返回前释放 lock
+    void enqueueTask(std::unique_lock<std::mutex> &lock, myTask &&task);
+    // 不等待的入队: 线程池未运行、队列已满或超出字节预算时返回 false, 不应用拒绝策略
+    bool tryEnqueueTask(TaskPtr task, size_t footprint);
+    bool popTask(myTask &task);
+    // 活跃链表只包含有任务且未达到并发上限的执行器, 调度时只看链表头, O(1)
+    void activateFlow(TaskFlow *flow);
+    // 查找或创建租户的队列, 调用者须持有 taskQueMtx_
+    TaskFlow *findTenantFlow(uint64_t tenant);
+    // 回收空闲且使用默认配置的租户队列, 调用方需持有 taskQueMtx_
+    void releaseIdleTenantFlows();
+    void destroyTenantFlow(TaskFlow *flow);
+    TaskFlowStats flowStats(const TaskFlow &flow) const;
+    // 任务执行完毕, 更新所属执行器的并发计数
+    void finishTask(TaskFlow *flow);
+    // 任务节点销毁后归还其占用的字节预算
+    void releaseTaskBytes(size_t footprint);
+    // 启动批次中第 index 个线程的子线程 (2 * index + 1 与 2 * index + 2)
+    void startBatchChildren(int index);
+    // 取得一个空闲槽位并在其上启动线程
+    void spawnThread();
+    // 无锁空闲槽位链表 (Treiber 栈)
+    int acquireSlot();
+    void releaseSlot(int index);
+
+#if defined(__linux__)
+    // io_uring 实例及一次异步读写请求, 定义见 threadpool.cpp
+    class IoRing;
+    struct IoRequest;
+    // 提交请求; io_uring 不可用或提交队列已满时在 I/O 线程池中同步读写
+    void submitIo(IoRequest *request, int fd, int64_t offset);
+    // 请求完成: 回调作为任务提交, 或直接设置 future 的结果
+    void completeIo(IoRequest *request, long result);
+
+    // epoll 实例及其 fd 注册表, 定义见 threadpool.cpp
+    class Reactor;
+    // 指标 HTTP 服务, 定义见 threadpool.cpp
+    class MetricsServer;
+    // 作为 leader 等待一次 epoll 事件并处理, 返回时重新持有 lock
+    // 调用者计入空闲线程数 (idleThreadSize 为其分片); 处理事件期间退出空闲计数
+    void runReactor(std::unique_lock<std::mutex> &lock, int threadid, std::atomic_int &idleThreadSize);
+#endif
+    // 唤醒阻塞在 epoll 上的 leader (非 Linux 平台为空操作)
+    void wakeReactor();
+
+    // 固定容量的线程槽位数组, 容量在 start() 时确定, 运行期间不再分配
+    // cached 模式下空闲超时退出的线程无法 join 自身, 由下一个取得该槽位的线程或 shutdown 负责 join
+    ResourceArray<Thread> threads_;
+    int threadCapacity_ = 0;
+    // 各线程槽位的任务缓冲区, 仅在开启批量取任务时分配
+    ResourceArray<TaskBatch> taskBatches_;
+    // 初始线程 (槽位 0..initThreadSize_-1) 的亲和队列, 延迟启动时不分配
+    // 这些槽位上的线程在线程池关闭前不会退出
+    ResourceArray<AffinityQueue> affinityQueues_;
+    int affinityQueueCount_ = 0;
+    // 拓扑感知时各槽位绑定的 CPU 与所在分组, 以及各分组包含的槽位; 未开启时为空
+    std::pmr::vector<int> workerCpu_;
+    std::pmr::vector<int> workerGroup_;
+    std::pmr::vector<std::pmr::vector<int>> groupSlots_;
 
-    std::priority_queue<myTask> taskQue_;
+    // ---- 配置项: 仅在 start() 之前修改, 运行期间只读 ----
+    std::pmr::memory_resource *memoryResource_; // 内部分配使用的上游内存资源
+    int initThreadSize_;
+    int threadSizeThreshHold_; // 线程数量上限
     int taskQueMaxThreshHold_; // 任务数量上限
+    size_t taskQueMaxBytes_ = 0; // 任务内存占用上限, 0 表示不限
+
+    PoolMode poolMode_;
+    RejectionPolicy rejectionPolicy_ = RejectionPolicy::Abort;
+    SchedulePolicy schedulePolicy_ = SchedulePolicy::Priority;
+
+    int spinCount_ = 0;  // 空闲时自旋次数
+    int yieldCount_ = 0; // 自旋后 yield 的次数
+    bool lazyStart_ = false;
+    int taskBatchSize_ = 1;
+    int affinityStealThreshHold_ = 16;
+    bool topologyAware_ = false;
+    bool alwaysNotify_ = false;
 
-    std::mutex taskQueMtx_;
+    // 任务内存资源: 默认为 TaskNodeResource, 按大小分级复用节点, 工作线程各有无锁的本地空闲链表
+    class TaskNodeResource;
+    std::shared_ptr<std::pmr::memory_resource> taskResource_;
+    TaskNodeResource *taskNodeResource_ = nullptr; // taskResource_ 为默认资源时指向它, start() 时为各槽位分配本地链表
+    int blockingThreadSizeThreshHold_;
+    int blockingCompensationThreshHold_ = 0;
+    std::once_flag blockingPoolOnce_;
+    std::unique_ptr<ThreadPool> blockingPool_; // submitBlocking() 的 I/O 线程池, 首次使用时创建
+    bool isBlockingLane_ = false;              // 本线程池即为其他线程池的 I/O 线程池
+
+    // 当前线程所属的线程池及其阻塞区域嵌套深度, 非工作线程为 nullptr
+    static thread_local ThreadPool *currentPool_;
+    static thread_local int blockingDepth_;
+    static thread_local int workerIndex_;
+
+#if defined(__linux__)
+    std::once_flag ioRingOnce_;
+    std::unique_ptr<IoRing> ioRing_; // 首次异步 I/O 时创建, 创建失败则为空
+    std::once_flag reactorOnce_;
+    std::unique_ptr<Reactor> reactor_; // 首次 addFd() 时创建
+    std::unique_ptr<MetricsServer> metricsServer_;
+#endif
+
+    // ---- 以下为多线程频繁读写的共享状态, 各自独占缓存行以避免伪共享 ----
+
+    // 任务队列及其同步原语, 均受 taskQueMtx_ 保护
+    alignas(CACHE_LINE_SIZE) std::mutex taskQueMtx_;
+    std::pmr::deque<TaskFlow> flows_; // 各执行器的任务队列, 0 号为默认执行器
+    std::pmr::unordered_map<uint64_t, TaskFlow *> tenantFlows_; // 租户 key 到其队列, 队列单独从 memoryResource_ 分配
+    std::pmr::unordered_map<uint64_t, TenantCounters> retiredTenants_; // 队列已被回收的租户的累计计数
+    size_t tenantSweepAt_ = TENANT_SWEEP_MIN; // 租户表达到该大小时回收空闲租户
+    TaskFlow *activeHead_ = nullptr; // 活跃链表 (DRR 轮转顺序)
+    TaskFlow *activeTail_ = nullptr;
     std::condition_variable notFull;
     std::condition_variable notEmpty;
-    std::condition_variable exitCond_;
+    int notFullWaiters_ = 0;  // 阻塞在 notFull 上的提交者数量
+    int notEmptyWaiters_ = 0; // 阻塞在 notEmpty 上的工作线程数量
+    int blockingThreadSize_ = 0; // 处于阻塞区域的工作线程数
+    bool reactorActive_ = false;       // reactor_ 已创建, 空闲线程应轮流作为 leader
+    bool reactorLeaderWaiting_ = false; // 有线程作为 leader 阻塞在 epoll 上
 
-    PoolMode poolMode_;
-    RejectionPolicy rejectionPolicy_ = RejectionPolicy::Abort;
+    alignas(CACHE_LINE_SIZE) std::atomic_bool isPoolRunning_;
+    alignas(CACHE_LINE_SIZE) std::atomic_int curThreadSize_;              // 当前线程数量
+    alignas(CACHE_LINE_SIZE) std::atomic_int pendingStartSize_{0};        // 已计入 curThreadSize_ 但尚未启动的线程数
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> freeSlotHead_{0};      // 空闲槽位链表头: 高 32 位为版本号, 低 32 位为槽位下标
+    alignas(CACHE_LINE_SIZE) std::atomic_int spinningThreadSize_{0};      // 正在自旋等待的线程数量
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> queuedTaskSize_{0};      // 所有执行器的排队任务总数, 在锁内修改
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> batchedTaskSize_{0};     // 各线程缓冲区中尚未执行的任务数
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> affinityTaskSize_{0};    // 各亲和队列中的任务总数
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> expiredTaskCount_{0};    // 因超过截止时间而被丢弃的任务数
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> outstandingTaskBytes_{0}; // 排队及执行中任务的内存占用
+    alignas(CACHE_LINE_SIZE) std::atomic_int spaceWaiters_{0};             // 阻塞在 notFull 上的提交者数量, 可在锁外读取
+
+    // 空闲线程数量: 每个工作线程只修改自己所在的分片, 读取时汇总
+    std::array<CounterShard, COUNTER_SHARDS> idleThreadShards_;
+
+#if THREADPOOL_STATS
+    // 统计分片: 每个线程槽位一个, 槽位首次启动线程时才分配, 从未使用的槽位不占内存;
+    // 另有 COUNTER_SHARDS 个外部分片由非工作线程共用, start() 时分配
+    ResourceArray<StatsSlot> statsSlots_;
+    ResourceArray<StatsShard> externalStats_;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> maxQueueDepth_{0}; // 在锁内更新
+#endif
+};
+
+// 每个工作线程一个按缓存行对齐的槽位, 工作线程无锁地读写自己的槽位, 之后再合并所有槽位
+// 须在线程池 start() 之后创建; 非本线程池工作线程的调用者 (例如参与 parallelFor 的调用线程) 共用一个额外槽位,
+// 同一时刻只能有一个这样的线程使用它
+template <typename T>
+class WorkerLocal
+{
+public:
+    explicit WorkerLocal(const ThreadPool &pool, const T &init = T())
+        : pool_(&pool), slots_((size_t)pool.getMaxThreadCount() + 1, Slot{init})
+    {
+        if (pool.getMaxThreadCount() == 0)
+        {
+            throw std::runtime_error("WorkerLocal requires a started ThreadPool");
+        }
+    }
+
+    // 当前线程的槽位
+    T &local()
+    {
+        size_t index = pool_->isWorkerThread() ? (size_t)ThreadPool::currentWorkerIndex() : slots_.size() - 1;
+        return slots_[index].value;
+    }
+
+    // 依次合并所有槽位: op(op(op(init, slot0), slot1), ...); 须在没有线程写入时调用
+    template <typename BinaryOp>
+    T combine(T init, BinaryOp op) const
+    {
+        for (const Slot &slot : slots_)
+        {
+            init = op(std::move(init), slot.value);
+        }
+        return init;
+    }
+
+    template <typename Func>
+    void forEach(Func func)
+    {
+        for (Slot &slot : slots_)
+        {
+            func(slot.value);
+        }
+    }
+
+    size_t size() const { return slots_.size(); }
 
-    std::atomic_bool isPoolRunning_;
+private:
+    struct alignas(ThreadPool::CACHE_LINE_SIZE) Slot
+    {
+        T value;
+    };
+
+    const ThreadPool *pool_;
+    std::vector<Slot> slots_;
 };
 
+template <typename R>
+decltype(auto) TaskFuture<R>::get()
+{
+    wait();
+    return std::future<R>::get();
+}
+
+template <typename R>
+void TaskFuture<R>::wait() const
+{
+    if (pool_ != nullptr && pool_->isWorkerThread())
+    {
+        pool_->helpWhileWaiting([this](std::chrono::microseconds timeout)
+                                { return this->wait_for(timeout) == std::future_status::ready; });
+    }
+    std::future<R>::wait();
+}
+
 #endif // THREADPOOL_H
\ No newline at end of file